@@ -0,0 +1,234 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../core/type_index.h"
+#include "../core/types.h"
+
+namespace fecs {
+
+    // Type-erased column of an archetype table, structural operations go through it
+    class column_base {
+    public:
+        virtual ~column_base() = default;
+
+        [[nodiscard]] virtual std::unique_ptr<column_base> make_empty() const = 0;
+        // Moves the value at row to the end of other (a column of the same type)
+        virtual void move_to(size_t row, column_base& other) = 0;
+        // Replaces row with the last value
+        virtual void swap_remove(size_t row) = 0;
+        virtual void reserve(size_t count) = 0;
+        virtual void shrink_to_fit() = 0;
+        [[nodiscard]] virtual size_t memory_usage() const = 0;
+    };
+
+    template<typename T>
+    class column final : public column_base {
+    public:
+        [[nodiscard]] std::unique_ptr<column_base> make_empty() const override {
+            return std::make_unique<column>();
+        }
+
+        void move_to(size_t row, column_base& other) override {
+            static_cast<column&>(other)._data.push_back(std::move(_data[row]));
+        }
+
+        void swap_remove(size_t row) override {
+            if (row + 1 != _data.size()) {
+                _data[row] = std::move(_data.back());
+            }
+            _data.pop_back();
+        }
+
+        void reserve(size_t count) override {
+            _data.reserve(count);
+        }
+
+        void shrink_to_fit() override {
+            _data.shrink_to_fit();
+        }
+
+        [[nodiscard]] size_t memory_usage() const override {
+            return _data.capacity() * sizeof(T);
+        }
+
+        template<typename... Args>
+        T& emplace_back(Args&&... args) {
+            return _data.emplace_back(std::forward<Args>(args)...);
+        }
+
+        [[nodiscard]] T* data() {
+            return _data.data();
+        }
+
+        [[nodiscard]] const T* data() const {
+            return _data.data();
+        }
+
+        T& operator[](size_t row) {
+            return _data[row];
+        }
+
+        const T& operator[](size_t row) const {
+            return _data[row];
+        }
+
+    private:
+        std::vector<T> _data;
+
+    };
+
+    // Table of all entities that have exactly the same set of components.
+    // Columns are sorted by component id, row i of every column belongs to entities()[i].
+    class archetype {
+    public:
+        static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+        archetype() = default;
+
+        archetype(const archetype&) = delete;
+        archetype& operator=(const archetype&) = delete;
+
+        // Table with the components of base plus one more column
+        archetype(const archetype& base, id_index_t id, std::unique_ptr<column_base> added)
+            : _types(base._types) {
+            const size_t at = static_cast<size_t>(std::lower_bound(_types.begin(), _types.end(), id) - _types.begin());
+            _types.insert(_types.begin() + static_cast<std::ptrdiff_t>(at), id);
+            for (size_t i = 0; i < base._columns.size(); ++i) {
+                _columns.push_back(base._columns[i]->make_empty());
+            }
+            _columns.insert(_columns.begin() + static_cast<std::ptrdiff_t>(at), std::move(added));
+        }
+
+        // Table with the components of base except id
+        archetype(const archetype& base, id_index_t id) {
+            for (size_t i = 0; i < base._types.size(); ++i) {
+                if (base._types[i] != id) {
+                    _types.push_back(base._types[i]);
+                    _columns.push_back(base._columns[i]->make_empty());
+                }
+            }
+        }
+
+        [[nodiscard]] const std::vector<id_index_t>& types() const {
+            return _types;
+        }
+
+        [[nodiscard]] size_t column_index(id_index_t id) const {
+            auto it = std::lower_bound(_types.begin(), _types.end(), id);
+            if (it == _types.end() || *it != id) {
+                return npos;
+            }
+            return static_cast<size_t>(it - _types.begin());
+        }
+
+        [[nodiscard]] bool has(id_index_t id) const {
+            return column_index(id) != npos;
+        }
+
+        [[nodiscard]] bool has_all(const std::vector<id_index_t>& ids) const {
+            return std::all_of(ids.begin(), ids.end(), [this](id_index_t id) { return has(id); });
+        }
+
+        // Column of T, T has to be one of the components of this table
+        template<typename T>
+        [[nodiscard]] column<T>& get_column() {
+            return static_cast<column<T>&>(*_columns[column_index(type_index<T>::value())]);
+        }
+
+        template<typename T>
+        [[nodiscard]] const column<T>& get_column() const {
+            return static_cast<const column<T>&>(*_columns[column_index(type_index<T>::value())]);
+        }
+
+        [[nodiscard]] const std::vector<entity_t>& entities() const {
+            return _entities;
+        }
+
+        [[nodiscard]] size_t size() const {
+            return _entities.size();
+        }
+
+        // Moves the row to the end of target, columns target does not have are dropped.
+        // Columns target has and this table does not are left for the caller to fill.
+        // Returns the row of entity in target.
+        size_t move_row(size_t row, archetype& target) {
+            for (size_t i = 0; i < _types.size(); ++i) {
+                const size_t j = target.column_index(_types[i]);
+                if (j != npos) {
+                    _columns[i]->move_to(row, *target._columns[j]);
+                }
+            }
+            target._entities.push_back(_entities[row]);
+            return target._entities.size() - 1;
+        }
+
+        size_t push_entity(entity_t entity) {
+            _entities.push_back(entity);
+            return _entities.size() - 1;
+        }
+
+        // Removes the row, returns the entity moved into it or error_entity if it was the last one
+        entity_t swap_remove(size_t row) {
+            for (auto& c : _columns) {
+                c->swap_remove(row);
+            }
+            entity_t moved = error_entity;
+            if (row + 1 != _entities.size()) {
+                moved = _entities.back();
+                _entities[row] = moved;
+            }
+            _entities.pop_back();
+            return moved;
+        }
+
+        void shrink_to_fit() {
+            _entities.shrink_to_fit();
+            for (auto& c : _columns) {
+                c->shrink_to_fit();
+            }
+        }
+
+        [[nodiscard]] size_t memory_usage() const {
+            size_t bytes = _entities.capacity() * sizeof(entity_t);
+            for (const auto& c : _columns) {
+                bytes += c->memory_usage();
+            }
+            return bytes;
+        }
+
+        // Neighbouring tables, so that adding or removing a component skips the lookup by type set
+        [[nodiscard]] archetype* add_edge(id_index_t id) const {
+            auto it = _add_edges.find(id);
+            return it != _add_edges.end() ? it->second : nullptr;
+        }
+
+        [[nodiscard]] archetype* remove_edge(id_index_t id) const {
+            auto it = _remove_edges.find(id);
+            return it != _remove_edges.end() ? it->second : nullptr;
+        }
+
+        void set_add_edge(id_index_t id, archetype* target) {
+            _add_edges[id] = target;
+        }
+
+        void set_remove_edge(id_index_t id, archetype* target) {
+            _remove_edges[id] = target;
+        }
+
+    private:
+        std::vector<id_index_t> _types;
+        std::vector<std::unique_ptr<column_base>> _columns;
+        std::vector<entity_t> _entities;
+        std::unordered_map<id_index_t, archetype*> _add_edges;
+        std::unordered_map<id_index_t, archetype*> _remove_edges;
+
+    };
+
+}
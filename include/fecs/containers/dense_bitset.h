@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+    #include <immintrin.h>
+#endif
+
+namespace fecs {
+
+    // One bit per key, grows on demand. Used as a membership mask of a pool.
+    class dense_bitset {
+    public:
+        using word_t = uint64_t;
+        static constexpr size_t word_bits = 64;
+
+        void set(size_t bit) {
+            const size_t w = bit / word_bits;
+            if (w >= _words.size()) {
+                _words.resize(w + 1, 0);
+            }
+            _words[w] |= word_t{1} << (bit % word_bits);
+        }
+
+        void reset(size_t bit) {
+            const size_t w = bit / word_bits;
+            if (w < _words.size()) {
+                _words[w] &= ~(word_t{1} << (bit % word_bits));
+            }
+        }
+
+        [[nodiscard]] bool test(size_t bit) const {
+            const size_t w = bit / word_bits;
+            return w < _words.size() && (_words[w] >> (bit % word_bits)) & 1;
+        }
+
+        void clear() {
+            _words.clear();
+        }
+
+        void shrink_to_fit() {
+            _words.shrink_to_fit();
+        }
+
+        [[nodiscard]] const word_t* data() const {
+            return _words.data();
+        }
+
+        [[nodiscard]] size_t word_count() const {
+            return _words.size();
+        }
+
+        [[nodiscard]] size_t memory_usage() const {
+            return _words.capacity() * sizeof(word_t);
+        }
+
+    private:
+        std::vector<word_t> _words;
+
+    };
+
+    // out[i] = sources[0][first + i] & ... & sources[count - 1][first + i] for i < words.
+    // Uses AVX2 or SSE2 when the target has them, scalar code otherwise.
+    inline void intersect_words(dense_bitset::word_t* out, const dense_bitset::word_t* const* sources,
+                                size_t count, size_t first, size_t words) {
+        size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 4 <= words; i += 4) {
+            __m256i acc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sources[0] + first + i));
+            for (size_t s = 1; s < count; ++s) {
+                acc = _mm256_and_si256(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sources[s] + first + i)));
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), acc);
+        }
+#elif defined(__SSE2__) || defined(_M_X64)
+        for (; i + 2 <= words; i += 2) {
+            __m128i acc = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sources[0] + first + i));
+            for (size_t s = 1; s < count; ++s) {
+                acc = _mm_and_si128(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(sources[s] + first + i)));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), acc);
+        }
+#endif
+        for (; i < words; ++i) {
+            dense_bitset::word_t acc = sources[0][first + i];
+            for (size_t s = 1; s < count; ++s) {
+                acc &= sources[s][first + i];
+            }
+            out[i] = acc;
+        }
+    }
+
+}
@@ -0,0 +1,312 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "dense_bitset.h"
+#include "sparse_set.h"
+#include "../core/type_traits.h"
+#include "../core/types.h"
+
+namespace fecs {
+
+    // Secondary index over a field of a component. Kept up to date through the
+    // pool mutation path: emplace, remove, patch and replace.
+    class index_descriptor : public pool::listener {
+    public:
+        ~index_descriptor() override = default;
+
+        virtual void rebuild() = 0;
+    };
+
+    template<auto Member>
+    requires std::is_member_object_pointer_v<decltype(Member)>
+    class index_base : public index_descriptor {
+    public:
+        using component_t = typename member_pointer_traits<decltype(Member)>::class_t;
+        using field_t = std::remove_cv_t<typename member_pointer_traits<decltype(Member)>::field_t>;
+        using pool_t = sparse_set<component_t>;
+
+        explicit index_base(pool_t* p)
+            : _pool(p) {
+            _pool->add_listener(this);
+        }
+
+        ~index_base() override {
+            _pool->remove_listener(this);
+        }
+
+        index_base(const index_base&) = delete;
+        index_base& operator=(const index_base&) = delete;
+
+    protected:
+        pool_t* _pool;
+
+        [[nodiscard]] const field_t& field_of(entity_t entity) const {
+            return _pool->get_ref(entity).*Member;
+        }
+
+    };
+
+    // Point lookups, entities sharing a value are stored contiguously
+    template<auto Member>
+    class hash_index : public index_base<Member> {
+    public:
+        using base_t = index_base<Member>;
+        using typename base_t::field_t;
+        using typename base_t::pool_t;
+
+        explicit hash_index(pool_t* p)
+            : base_t(p) {
+            rebuild();
+        }
+
+        [[nodiscard]] std::span<const entity_t> find(const field_t& value) const {
+            auto it = _buckets.find(value);
+            if (it == _buckets.end()) {
+                return {};
+            }
+            return it->second;
+        }
+
+        [[nodiscard]] bool contains(const field_t& value) const {
+            return _buckets.contains(value);
+        }
+
+        void rebuild() override {
+            _buckets.clear();
+            _entries = sparse_set<entry>();
+            _pool->for_each([this](entity_t e, const auto&) {
+                insert(e);
+            });
+        }
+
+        void on_emplace(entity_t entity) override {
+            insert(entity);
+        }
+
+        void on_update(entity_t entity) override {
+            if (!(_entries.get_ref(entity).value == this->field_of(entity))) {
+                erase(entity);
+                insert(entity);
+            }
+        }
+
+        void on_remove(entity_t entity) override {
+            erase(entity);
+        }
+
+    private:
+        using base_t::_pool;
+
+        // Indexed value and position inside its bucket
+        struct entry {
+            field_t value;
+            size_t position;
+        };
+
+        std::unordered_map<field_t, std::vector<entity_t>> _buckets;
+        sparse_set<entry> _entries;
+
+        void insert(entity_t entity) {
+            const field_t& value = this->field_of(entity);
+            std::vector<entity_t>& bucket = _buckets[value];
+            _entries.emplace(entity, entry{ value, bucket.size() });
+            bucket.push_back(entity);
+        }
+
+        void erase(entity_t entity) {
+            const entry& e = _entries.get_ref(entity);
+            auto it = _buckets.find(e.value);
+            std::vector<entity_t>& bucket = it->second;
+
+            const entity_t moved = bucket.back();
+            bucket[e.position] = moved;
+            _entries.get_ref(moved).position = e.position;
+            bucket.pop_back();
+
+            if (bucket.empty()) {
+                _buckets.erase(it);
+            }
+            _entries.remove(entity);
+        }
+
+    };
+
+    // Point and range lookups, entities are kept sorted by (value, entity).
+    // Changes are buffered and merged in one pass before the next lookup, so bulk
+    // loads cost O(n log n) instead of a vector insert per entity.
+    // A lookup after changes writes the merge, so it must not run concurrently with other lookups.
+    template<auto Member>
+    class ordered_index : public index_base<Member> {
+    public:
+        using base_t = index_base<Member>;
+        using typename base_t::field_t;
+        using typename base_t::pool_t;
+
+        explicit ordered_index(pool_t* p)
+            : base_t(p) {
+            rebuild();
+        }
+
+        [[nodiscard]] std::span<const entity_t> find(const field_t& value) const {
+            merge();
+            return range_of(lower_bound(value), upper_bound(value));
+        }
+
+        // Entities with first <= value < last
+        [[nodiscard]] std::span<const entity_t> range(const field_t& first, const field_t& last) const {
+            merge();
+            const size_t b = lower_bound(first);
+            return range_of(b, std::max(b, lower_bound(last)));
+        }
+
+        // Entities with first <= value <= last
+        [[nodiscard]] std::span<const entity_t> range_inclusive(const field_t& first, const field_t& last) const {
+            merge();
+            const size_t b = lower_bound(first);
+            return range_of(b, std::max(b, upper_bound(last)));
+        }
+
+        [[nodiscard]] std::span<const entity_t> entities() const {
+            merge();
+            return _entities;
+        }
+
+        void rebuild() override {
+            _values.clear();
+            _entities.clear();
+            _pending.clear();
+            _erased.clear();
+            _erased_count = 0;
+            _indexed = sparse_set<field_t>();
+            _pool->for_each([this](entity_t e, const auto&) {
+                _indexed.emplace(e, this->field_of(e));
+                _pending.push_back(e);
+            });
+            merge();
+        }
+
+        void on_emplace(entity_t entity) override {
+            insert(entity);
+        }
+
+        void on_update(entity_t entity) override {
+            if (!(_indexed.get_ref(entity) == this->field_of(entity))) {
+                erase(entity);
+                insert(entity);
+            }
+        }
+
+        void on_remove(entity_t entity) override {
+            erase(entity);
+        }
+
+    private:
+        using base_t::_pool;
+
+        // Merged entries, sorted
+        mutable std::vector<field_t> _values;
+        mutable std::vector<entity_t> _entities;
+        // Inserted since the last merge, may hold entities that were erased again
+        mutable std::vector<entity_t> _pending;
+        // Positions of merged entries erased since the last merge
+        mutable dense_bitset _erased;
+        mutable size_t _erased_count = 0;
+        // Value every entity was indexed with, needed once the pool already holds a new one
+        sparse_set<field_t> _indexed;
+
+        static bool less(const field_t& va, entity_t a, const field_t& vb, entity_t b) {
+            if (va < vb) return true;
+            if (vb < va) return false;
+            return a < b;
+        }
+
+        [[nodiscard]] std::span<const entity_t> range_of(size_t first, size_t last) const {
+            return std::span<const entity_t>(_entities.data() + first, last - first);
+        }
+
+        [[nodiscard]] size_t lower_bound(const field_t& value) const {
+            return static_cast<size_t>(std::lower_bound(_values.begin(), _values.end(), value) - _values.begin());
+        }
+
+        [[nodiscard]] size_t upper_bound(const field_t& value) const {
+            return static_cast<size_t>(std::upper_bound(_values.begin(), _values.end(), value) - _values.begin());
+        }
+
+        // First position whose (value, entity) is not less than the given pair
+        [[nodiscard]] size_t position_of(const field_t& value, entity_t entity) const {
+            size_t first = lower_bound(value);
+            size_t count = upper_bound(value) - first;
+            while (count > 0) {
+                const size_t step = count / 2;
+                const size_t mid = first + step;
+                if (_entities[mid] < entity) {
+                    first = mid + 1;
+                    count -= step + 1;
+                }
+                else {
+                    count = step;
+                }
+            }
+            return first;
+        }
+
+        void insert(entity_t entity) {
+            _indexed.emplace(entity, this->field_of(entity));
+            _pending.push_back(entity);
+        }
+
+        // Merged entries are only marked, pending ones are dropped by the merge
+        void erase(entity_t entity) {
+            const size_t pos = position_of(_indexed.get_ref(entity), entity);
+            if (pos < _entities.size() && _entities[pos] == entity && !_erased.test(pos)) {
+                _erased.set(pos);
+                ++_erased_count;
+            }
+            _indexed.remove(entity);
+        }
+
+        void merge() const {
+            if (_pending.empty() && _erased_count == 0) {
+                return;
+            }
+            const auto by_value = [this](entity_t a, entity_t b) {
+                return less(_indexed.get_ref(a), a, _indexed.get_ref(b), b);
+            };
+            std::erase_if(_pending, [this](entity_t e) { return !_indexed.contains(e); });
+            std::sort(_pending.begin(), _pending.end(), by_value);
+            _pending.erase(std::unique(_pending.begin(), _pending.end()), _pending.end());
+
+            std::vector<field_t> values;
+            std::vector<entity_t> entities;
+            values.reserve(_values.size() - _erased_count + _pending.size());
+            entities.reserve(values.capacity());
+            size_t p = 0;
+            for (size_t i = 0; i <= _entities.size(); ++i) {
+                // Pending entries that sort before the merged entry at i
+                while (p < _pending.size() && (i == _entities.size()
+                       || less(_indexed.get_ref(_pending[p]), _pending[p], _values[i], _entities[i]))) {
+                    values.push_back(_indexed.get_ref(_pending[p]));
+                    entities.push_back(_pending[p]);
+                    ++p;
+                }
+                if (i < _entities.size() && !_erased.test(i)) {
+                    values.push_back(std::move(_values[i]));
+                    entities.push_back(_entities[i]);
+                }
+            }
+            _values = std::move(values);
+            _entities = std::move(entities);
+            _pending.clear();
+            _erased.clear();
+            _erased_count = 0;
+        }
+
+    };
+
+}
@@ -0,0 +1,413 @@
+#pragma once
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sparse_set.h"
+#include "../core/types.h"
+#include "../util/log.h"
+
+namespace fecs {
+
+    enum class mapped_status {
+        ok,
+        io_error,
+        bad_magic,
+        bad_version,
+        type_mismatch,
+        truncated,
+        corrupted
+    };
+
+    // Sparse set of trivially copyable components whose keys, values and sparse pages
+    // live in one memory-mapped file. Reopening the file makes the pool available right
+    // away, pages are faulted in when they are first touched.
+    //
+    // File layout: header | keys | values | sparse pages, regions are 64-byte aligned.
+    // The file is only valid for the same component layout and entity_t, which the header records.
+    // Pointers and references are invalidated when the set grows, like with std::vector.
+    template<typename T>
+    requires std::is_trivially_copyable_v<T>
+    class mapped_sparse_set {
+    public:
+        static constexpr uint64_t magic = 0x50414d5343454646; // "FFECSMAP"
+        static constexpr uint32_t format_version = 1;
+        // Returned by emplace when nothing was written
+        static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+        // Opens the file or creates an empty set in it. Only the header is checked,
+        // call validate for a full consistency pass.
+        explicit mapped_sparse_set(const std::string& path, size_t reservation = 1024) {
+            _fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+            if (_fd < 0) {
+                _status = mapped_status::io_error;
+                return;
+            }
+            struct stat st;
+            if (::fstat(_fd, &st) != 0) {
+                _status = mapped_status::io_error;
+                return;
+            }
+            if (st.st_size == 0) {
+                create(std::max<size_t>(reservation, 1));
+            }
+            else {
+                open_existing(static_cast<size_t>(st.st_size));
+            }
+            if (_status != mapped_status::ok) {
+                FECS_LOG_WARN << "Could not map " << path << FECS_NL;
+            }
+        }
+
+        mapped_sparse_set(const mapped_sparse_set&) = delete;
+        mapped_sparse_set& operator=(const mapped_sparse_set&) = delete;
+
+        ~mapped_sparse_set() {
+            unmap();
+            if (_fd >= 0) {
+                ::close(_fd);
+            }
+        }
+
+        [[nodiscard]] mapped_status status() const {
+            return _status;
+        }
+
+        [[nodiscard]] bool is_open() const {
+            return _status == mapped_status::ok;
+        }
+
+        // Checks the header and that every key and sparse slot point at each other.
+        // Touches every page of the file.
+        [[nodiscard]] mapped_status validate() const {
+            if (_status != mapped_status::ok) {
+                return _status;
+            }
+            const size_t count = size();
+            for (size_t i = 0; i < count; ++i) {
+                const entity_t key = _keys[i];
+                if (key / SPARSE_MAX_SIZE >= _header->pages || slot(key) != i) {
+                    return mapped_status::corrupted;
+                }
+            }
+            size_t used = 0;
+            const size_t slots = _header->pages * SPARSE_MAX_SIZE;
+            for (size_t s = 0; s < slots; ++s) {
+                if (_sparse[s] == error_index) {
+                    continue;
+                }
+                if (_sparse[s] >= count || _keys[_sparse[s]] != s) {
+                    return mapped_status::corrupted;
+                }
+                ++used;
+            }
+            return used == count ? mapped_status::ok : mapped_status::corrupted;
+        }
+
+        // Returns the index of the value, or npos if the set is not open or its file could not grow
+        template<typename... Args>
+        requires std::is_constructible_v<T, Args...>
+        size_t emplace(entity_t key, Args&&... args) {
+            if (!is_open()) {
+                return npos;
+            }
+            size_t index = get_index(key);
+            if (index != error_index) {
+                _values[index] = T(std::forward<Args>(args)...);
+                return index;
+            }
+            index = size();
+            if (!grow(index + 1, key / SPARSE_MAX_SIZE + 1)) {
+                return npos;
+            }
+            _keys[index] = key;
+            ::new (static_cast<void*>(_values + index)) T(std::forward<Args>(args)...);
+            slot(key) = static_cast<index_t>(index);
+            ++_header->count;
+            return index;
+        }
+
+        void remove(entity_t key) {
+            const size_t index = get_index(key);
+            if (index == error_index) {
+                return;
+            }
+            const size_t last = size() - 1;
+            if (index != last) {
+                _keys[index] = _keys[last];
+                _values[index] = _values[last];
+                slot(_keys[index]) = static_cast<index_t>(index);
+            }
+            slot(key) = error_index;
+            --_header->count;
+        }
+
+        [[nodiscard]] bool contains(entity_t key) const {
+            return get_index(key) != error_index;
+        }
+
+        T* get_ptr(entity_t key) {
+            const size_t index = get_index(key);
+            return index != error_index ? _values + index : nullptr;
+        }
+
+        const T* get_ptr(entity_t key) const {
+            const size_t index = get_index(key);
+            return index != error_index ? _values + index : nullptr;
+        }
+
+        T& get_ref(entity_t key) {
+            const size_t index = get_index(key);
+            FECS_ASSERT(index != error_index);
+            return _values[index];
+        }
+
+        const T& get_ref(entity_t key) const {
+            const size_t index = get_index(key);
+            FECS_ASSERT(index != error_index);
+            return _values[index];
+        }
+
+        [[nodiscard]] size_t size() const {
+            return _header != nullptr ? static_cast<size_t>(_header->count) : 0;
+        }
+
+        [[nodiscard]] size_t capacity() const {
+            return _header != nullptr ? static_cast<size_t>(_header->capacity) : 0;
+        }
+
+        [[nodiscard]] std::span<const entity_t> keys() const {
+            return { _keys, size() };
+        }
+
+        [[nodiscard]] std::span<T> values() {
+            return { _values, size() };
+        }
+
+        [[nodiscard]] std::span<const T> values() const {
+            return { _values, size() };
+        }
+
+        template<typename Func>
+        requires std::is_invocable_v<Func, T&> || std::is_invocable_v<Func, entity_t, T&>
+        void for_each(Func func) {
+            const size_t s = size();
+            if constexpr (std::is_invocable_v<Func, T&>) {
+                for (size_t i = 0; i < s; ++i) {
+                    func(_values[i]);
+                }
+            }
+            else {
+                for (size_t i = 0; i < s; ++i) {
+                    func(_keys[i], _values[i]);
+                }
+            }
+        }
+
+        template<typename Func>
+        requires std::is_invocable_v<Func, const T&> || std::is_invocable_v<Func, entity_t, const T&>
+        void for_each(Func func) const {
+            const size_t s = size();
+            if constexpr (std::is_invocable_v<Func, const T&>) {
+                for (size_t i = 0; i < s; ++i) {
+                    func(_values[i]);
+                }
+            }
+            else {
+                for (size_t i = 0; i < s; ++i) {
+                    func(_keys[i], _values[i]);
+                }
+            }
+        }
+
+        // Writes dirty pages back to the file and waits for it
+        bool flush() {
+            return _base != nullptr && ::msync(_base, _mapped_size, MS_SYNC) == 0;
+        }
+
+    private:
+        // Entities are 32 bit, so are the dense indices, which halves the sparse pages
+        using index_t = uint32_t;
+        static constexpr index_t error_index = std::numeric_limits<index_t>::max();
+        static constexpr size_t region_alignment = 64;
+
+        struct header {
+            uint64_t magic;
+            uint32_t version;
+            uint32_t header_size;
+            uint64_t key_size;
+            uint64_t value_size;
+            uint64_t value_alignment;
+            uint64_t page_size;
+            uint64_t count;
+            uint64_t capacity;
+            uint64_t pages;
+        };
+
+        struct layout {
+            size_t keys;
+            size_t values;
+            size_t sparse;
+            size_t file_size;
+        };
+
+        int _fd = -1;
+        mapped_status _status = mapped_status::ok;
+        void* _base = nullptr;
+        size_t _mapped_size = 0;
+        header* _header = nullptr;
+        entity_t* _keys = nullptr;
+        T* _values = nullptr;
+        index_t* _sparse = nullptr;
+
+        static size_t align_up(size_t value, size_t alignment) {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        static layout compute_layout(size_t capacity, size_t pages) {
+            layout l;
+            l.keys = align_up(sizeof(header), region_alignment);
+            l.values = align_up(l.keys + capacity * sizeof(entity_t), std::max(region_alignment, alignof(T)));
+            l.sparse = align_up(l.values + capacity * sizeof(T), region_alignment);
+            l.file_size = l.sparse + pages * SPARSE_MAX_SIZE * sizeof(index_t);
+            return l;
+        }
+
+        [[nodiscard]] size_t get_index(entity_t key) const {
+            if (_header == nullptr || key / SPARSE_MAX_SIZE >= _header->pages) {
+                return error_index;
+            }
+            const index_t index = slot(key);
+            return index == error_index ? static_cast<size_t>(error_index) : index;
+        }
+
+        index_t& slot(entity_t key) {
+            return _sparse[key];
+        }
+
+        const index_t& slot(entity_t key) const {
+            return _sparse[key];
+        }
+
+        bool map(size_t bytes) {
+            unmap();
+            void* base = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+            if (base == MAP_FAILED) {
+                _status = mapped_status::io_error;
+                return false;
+            }
+            _base = base;
+            _mapped_size = bytes;
+            _header = static_cast<header*>(_base);
+            return true;
+        }
+
+        void unmap() {
+            if (_base != nullptr) {
+                ::munmap(_base, _mapped_size);
+                _base = nullptr;
+                _header = nullptr;
+                _keys = nullptr;
+                _values = nullptr;
+                _sparse = nullptr;
+            }
+        }
+
+        void bind(const layout& l) {
+            char* base = static_cast<char*>(_base);
+            _keys = reinterpret_cast<entity_t*>(base + l.keys);
+            _values = reinterpret_cast<T*>(base + l.values);
+            _sparse = reinterpret_cast<index_t*>(base + l.sparse);
+        }
+
+        void create(size_t capacity) {
+            const layout l = compute_layout(capacity, 1);
+            if (::ftruncate(_fd, static_cast<off_t>(l.file_size)) != 0 || !map(l.file_size)) {
+                _status = mapped_status::io_error;
+                return;
+            }
+            *_header = header{ magic, format_version, sizeof(header), sizeof(entity_t), sizeof(T), alignof(T),
+                               SPARSE_MAX_SIZE, 0, capacity, 1 };
+            bind(l);
+            std::memset(_sparse, 0xFF, SPARSE_MAX_SIZE * sizeof(index_t));
+        }
+
+        void open_existing(size_t file_size) {
+            if (file_size < sizeof(header) || !map(file_size)) {
+                _status = file_size < sizeof(header) ? mapped_status::truncated : mapped_status::io_error;
+                return;
+            }
+            const header& h = *_header;
+            if (h.magic != magic) {
+                _status = mapped_status::bad_magic;
+            }
+            else if (h.version != format_version || h.header_size != sizeof(header)) {
+                _status = mapped_status::bad_version;
+            }
+            else if (h.key_size != sizeof(entity_t) || h.value_size != sizeof(T)
+                  || h.value_alignment != alignof(T) || h.page_size != SPARSE_MAX_SIZE) {
+                _status = mapped_status::type_mismatch;
+            }
+            else if (h.count > h.capacity || compute_layout(h.capacity, h.pages).file_size > file_size) {
+                _status = mapped_status::truncated;
+            }
+            if (_status != mapped_status::ok) {
+                unmap();
+                return;
+            }
+            bind(compute_layout(h.capacity, h.pages));
+        }
+
+        // Makes room for count elements and keys below pages * SPARSE_MAX_SIZE.
+        // Regions only move towards the end of the file, the last one first.
+        // If the file can't be extended the set stays as it was, if it can't be
+        // mapped again the set is closed with io_error.
+        bool grow(size_t count, size_t pages) {
+            const size_t old_capacity = _header->capacity;
+            const size_t old_pages = _header->pages;
+            if (count <= old_capacity && pages <= old_pages) {
+                return true;
+            }
+            const size_t new_capacity = count <= old_capacity ? old_capacity : std::max(count, old_capacity * 2);
+            const size_t new_pages = pages <= old_pages ? old_pages : std::max(pages, old_pages * 2);
+            const layout from = compute_layout(old_capacity, old_pages);
+            const layout to = compute_layout(new_capacity, new_pages);
+            const size_t elements = size();
+
+            if (::ftruncate(_fd, static_cast<off_t>(to.file_size)) != 0) {
+                FECS_LOG_WARN << "mapped_sparse_set could not extend its file to " << to.file_size << " bytes" << FECS_NL;
+                return false;
+            }
+            if (!map(to.file_size)) {
+                FECS_LOG_ERR << "mapped_sparse_set could not map its grown file" << FECS_NL;
+                return false;
+            }
+            char* base = static_cast<char*>(_base);
+            std::memmove(base + to.sparse, base + from.sparse, old_pages * SPARSE_MAX_SIZE * sizeof(index_t));
+            std::memmove(base + to.values, base + from.values, elements * sizeof(T));
+            bind(to);
+            std::memset(_sparse + old_pages * SPARSE_MAX_SIZE, 0xFF, (new_pages - old_pages) * SPARSE_MAX_SIZE * sizeof(index_t));
+            _header->capacity = new_capacity;
+            _header->pages = new_pages;
+            return true;
+        }
+
+    };
+
+}
+
+#endif
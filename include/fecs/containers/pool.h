@@ -1,8 +1,11 @@
 #pragma once
 
 #include <stddef.h>
+#include <atomic>
+#include <cstdint>
 #include <vector>
 
+#include "dense_bitset.h"
 #include "../core/types.h"
 
 namespace fecs {
@@ -17,6 +20,7 @@ namespace fecs {
             virtual ~owner() = default;
 
             virtual void trigger_emplace(Key key) = 0;
+            // Called before the key is removed from the pool
             virtual void trigger_remove(Key key) = 0;
 
         protected:
@@ -30,6 +34,17 @@ namespace fecs {
 
         };
 
+        // Observes value changes of a pool, e.g. to maintain an index.
+        // on_remove is called while the value is still in the pool.
+        class listener {
+        public:
+            virtual ~listener() = default;
+
+            virtual void on_emplace(Key key) = 0;
+            virtual void on_update(Key key) = 0;
+            virtual void on_remove(Key key) = 0;
+        };
+
         using keys_container = std::vector<Key>;
 
         virtual ~pool_template() = default;
@@ -42,18 +57,147 @@ namespace fecs {
             return _keys[index];
         }
 
+        // Changes whenever elements are removed, move to other indices or keys change,
+        // so resumable cursors know their position is no longer valid.
+        // Only appends keep it, together with size() it tells whether the order is unchanged.
+        [[nodiscard]] uint64_t version() const {
+            return _version;
+        }
+
+        // Like version(), but kept by removals, which only fill the removed slot with the last element.
+        // Cursors walk from the back, so those never move an entity they haven't visited past them.
+        [[nodiscard]] uint64_t order_version() const {
+            return _version - _removals;
+        }
+
+        [[nodiscard]] owner* get_owner() const {
+            return _owner;
+        }
+
+        // Used when a pool leaves the registry that created its owner
+        void detach_owner() {
+            _owner = nullptr;
+        }
+
+        // Keeps a bit per key, so views over tracked pools can intersect whole words at once
+        void set_membership_tracking(bool enabled) {
+            _track_membership = enabled;
+            rebuild_membership();
+        }
+
+        // Null if membership is not tracked
+        [[nodiscard]] const dense_bitset* membership() const {
+            return _track_membership ? &_membership : nullptr;
+        }
+
+        // Views record how often their membership checks against this pool fail,
+        // so the next plan can run the most selective checks first.
+        // Relaxed counters, concurrent read-only views may update them.
+        void record_checks(uint64_t checks, uint64_t rejections) {
+            if (checks == 0) {
+                return;
+            }
+            std::atomic_ref<uint64_t> stored_checks(_checks);
+            std::atomic_ref<uint64_t> stored_rejections(_rejections);
+            uint64_t total_checks = stored_checks.load(std::memory_order_relaxed) + checks;
+            uint64_t total_rejections = stored_rejections.load(std::memory_order_relaxed) + rejections;
+            // Older results fade out, so the rate follows changing data
+            while (total_checks > check_history) {
+                total_checks /= 2;
+                total_rejections /= 2;
+            }
+            stored_checks.store(total_checks, std::memory_order_relaxed);
+            stored_rejections.store(total_rejections, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] uint64_t recorded_checks() const {
+            return std::atomic_ref<const uint64_t>(_checks).load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] uint64_t recorded_rejections() const {
+            return std::atomic_ref<const uint64_t>(_rejections).load(std::memory_order_relaxed);
+        }
+
+        // Share of recorded checks that failed, fallback while too few were recorded
+        [[nodiscard]] double rejection_rate(double fallback) const {
+            const uint64_t checks = recorded_checks();
+            if (checks < min_recorded_checks) {
+                return fallback;
+            }
+            return static_cast<double>(recorded_rejections()) / static_cast<double>(checks);
+        }
+
+        void add_listener(listener* l) {
+            _listeners.push_back(l);
+        }
+
+        void remove_listener(listener* l) {
+            std::erase(_listeners, l);
+        }
+
         virtual void remove(Key key) = 0;
         [[nodiscard]] virtual size_t size() const = 0;
+        [[nodiscard]] virtual size_t capacity() const = 0;
+        [[nodiscard]] virtual size_t sparse_pages() const = 0;
+        // Bytes allocated by the pool, including unused capacity
+        [[nodiscard]] virtual size_t memory_usage() const = 0;
         [[nodiscard]] virtual bool contains(Key key) const = 0;
         [[nodiscard]] virtual bool contains(size_t page, size_t offset) const = 0;
         virtual void swap(Key k1, Key k2) = 0;
         virtual void shrink_to_fit() = 0;
+        // Adds offset to every key. Keys must stay unique.
+        virtual void offset_keys(Key offset) = 0;
+        // Replaces every key k with remap[k], the new keys must be unique. Element order is kept.
+        virtual void remap_keys(const keys_container& remap) = 0;
+        // Moves all elements of other (same component type) to the end, shifting their keys by offset.
+        // Owner is not triggered, caller is responsible for repacking it.
+        virtual void append(pool_template&& other, Key offset) = 0;
+        // Moves the given keys to [0, keys.size()) in that order, the rest ends up behind them.
+        // Every key must be in the pool. Bulk alternative to one virtual swap per key.
+        virtual void arrange_front(const keys_container& keys) = 0;
 
     protected:
         friend class owner;
 
         keys_container _keys;
         owner* _owner = nullptr;
+        std::vector<listener*> _listeners;
+        dense_bitset _membership;
+        bool _track_membership = false;
+        uint64_t _version = 0;
+        uint64_t _removals = 0;
+        alignas(std::atomic_ref<uint64_t>::required_alignment) uint64_t _checks = 0;
+        alignas(std::atomic_ref<uint64_t>::required_alignment) uint64_t _rejections = 0;
+
+        static constexpr uint64_t check_history = uint64_t(1) << 20;
+        static constexpr uint64_t min_recorded_checks = 64;
+
+        void rebuild_membership() {
+            _membership.clear();
+            if (_track_membership) {
+                for (const Key key : _keys) {
+                    _membership.set(key);
+                }
+            }
+        }
+
+        void notify_emplace(Key key) const {
+            for (listener* l : _listeners) {
+                l->on_emplace(key);
+            }
+        }
+
+        void notify_update(Key key) const {
+            for (listener* l : _listeners) {
+                l->on_update(key);
+            }
+        }
+
+        void notify_remove(Key key) const {
+            for (listener* l : _listeners) {
+                l->on_remove(key);
+            }
+        }
 
         virtual void remove_by_self(Key key) = 0;
 
@@ -1,14 +1,21 @@
 #pragma once
 
+#include <algorithm>
 #include <limits>
+#include <memory>
 #include <type_traits>
 #include <utility>
 #include <vector>
 #include <array>
+#include <iterator>
 
+#include "../core/component_traits.h"
 #include "../core/type_traits.h"
+#include "../util/aligned_allocator.h"
 #include "../util/log.h"
+#include "../util/prefetch.h"
 #include "pool.h"
+#include "tag_storage.h"
 #include "fecs/core/type_index.h"
 
 #define SPARSE_MAX_SIZE 512
@@ -17,11 +24,19 @@ namespace fecs {
 
     template<typename Key, typename T, size_t chunk_size = 512>
     requires std::is_unsigned_v<Key> && (!std::is_pointer_v<T>)
-    class sparse_set_template : public pool_template<Key> {
+    class sparse_set_template final : public pool_template<Key> {
     public:
         using pool_t = pool_template<Key>;
         using sparse = std::array<size_t, chunk_size>;
-        using packed_t = std::vector<T>;
+        // Empty types keep only keys, there is nothing worth storing per element
+        static constexpr bool is_tag = std::is_empty_v<T>;
+        static constexpr bool double_buffered = component_traits<T>::double_buffered;
+        static_assert(!(is_tag && double_buffered), "Tags have no values to double buffer");
+        // Guaranteed alignment of data(), see component_traits
+        static constexpr size_t alignment = std::max(component_traits<T>::alignment, alignof(T));
+        using values_t = std::conditional_t<(alignment > alignof(T)),
+            std::vector<T, aligned_allocator<T, alignment>>, std::vector<T>>;
+        using packed_t = std::conditional_t<is_tag, tag_storage<T>, values_t>;
 
         using iterator = typename packed_t::iterator;
         using const_iterator = typename packed_t::const_iterator;
@@ -31,6 +46,9 @@ namespace fecs {
         explicit sparse_set_template(size_t reservation = 10){
             _packed.reserve(reservation);
             _keys.reserve(reservation);
+            if constexpr (double_buffered) {
+                _front.reserve(reservation);
+            }
             resize_sparses(1);
         }
 
@@ -42,15 +60,20 @@ namespace fecs {
             if(index == error_index) {
                 index = _packed.size();
                 _packed.emplace_back(std::forward<Args>(args)...);
+                if constexpr (double_buffered) {
+                    _front.push_back(_packed.back());
+                }
                 _keys.push_back(key);
                 set_index(key, index);
 
                 if(_owner != nullptr) {
                     _owner->trigger_emplace(key);
                 }
+                notify_emplace(key);
             }
             else{
-                _packed.emplace(_packed.begin() + index, std::forward<Args>(args)...);
+                _packed[index] = T(std::forward<Args>(args)...);
+                notify_update(key);
             }
             return index;
         }
@@ -63,26 +86,74 @@ namespace fecs {
             if(index == error_index) {
                 index = _packed.size();
                 _packed.emplace_back(std::forward<Args>(args)...);
+                if constexpr (double_buffered) {
+                    _front.push_back(_packed.back());
+                }
                 _keys.push_back(key);
                 set_index(key, index);
 
                 if(_owner != nullptr){
                     _owner->trigger_emplace(key);
                 }
+                notify_emplace(key);
             }
             return index;
         }
 
+        // Appends count keys that are not in the pool yet with their values (ignored for tags).
+        // Listeners are notified, the owner is not: the caller triggers it for every key
+        // once all pools of the batch are filled.
+        void insert_bulk(const Key* keys, const T* values, size_t count) {
+            const size_t first = _packed.size();
+            if constexpr (is_tag) {
+                for (size_t i = 0; i < count; ++i) {
+                    _packed.emplace_back();
+                }
+            }
+            else {
+                _packed.insert(_packed.end(), values, values + count);
+                if constexpr (double_buffered) {
+                    _front.insert(_front.end(), values, values + count);
+                }
+            }
+            _keys.insert(_keys.end(), keys, keys + count);
+            for (size_t i = 0; i < count; ++i) {
+                FECS_ASSERT(get_index(keys[i]) == error_index);
+                set_index(keys[i], first + i);
+            }
+            for (size_t i = 0; i < count; ++i) {
+                notify_emplace(keys[i]);
+            }
+        }
+
+        // Modifies a value through the mutation path, so listeners see the change
+        template<typename Func>
+        requires std::is_invocable_v<Func, T&>
+        void patch(Key key, Func func) {
+            size_t index = get_index(key);
+            FECS_ASSERT(index != error_index);
+
+            func(_packed[index]);
+            notify_update(key);
+        }
+
+        template<typename... Args>
+        requires std::is_constructible_v<T, Args...>
+        void replace(Key key, Args&&... args) {
+            patch(key, [&](T& value) { value = T(std::forward<Args>(args)...); });
+        }
+
         void remove(Key key) override {
             size_t index = get_index(key);
             if (index == error_index) return;
 
+            notify_remove(key);
+
+            // Owner moves the key out of its packed range first
             if(_owner != nullptr){
                 _owner->trigger_remove(key);
             }
-            else{
-                remove_by_self(key);
-            }
+            remove_by_self(key);
         }
 
         void swap(Key k1, Key k2) override {
@@ -94,10 +165,14 @@ namespace fecs {
             }
 
             std::swap(_packed[i1], _packed[i2]);
+            if constexpr (double_buffered) {
+                std::swap(_front[i1], _front[i2]);
+            }
             std::swap(_keys[i1], _keys[i2]);
 
             set_index(k1, i2);
             set_index(k2, i1);
+            ++_version;
         }
 
         bool contains(Key key) const override{
@@ -112,22 +187,133 @@ namespace fecs {
         }
 
         [[nodiscard]] bool contains(size_t page, size_t offset) const override{
-            if(page > _sparses.size()) return false;
-            return _sparses[page][offset != error_index];
+            if(page >= _sparses.size()) return false;
+            return _sparses[page][offset] != error_index;
         }
 
         [[nodiscard]] size_t size() const override{
             return _packed.size();
         }
 
+        [[nodiscard]] size_t capacity() const override {
+            return _packed.capacity();
+        }
+
+        [[nodiscard]] size_t sparse_pages() const override {
+            return _sparses.size();
+        }
+
+        [[nodiscard]] size_t memory_usage() const override {
+            return (_packed.capacity() + _front.capacity()) * sizeof(T)
+                 + _keys.capacity() * sizeof(Key)
+                 + _sparses.capacity() * sizeof(sparse)
+                 + _membership.memory_usage();
+        }
+
+        // Also drops the sparse pages above the largest key. Pages stay one flat array, so that
+        // a lookup is a single load, renumbering keys densely lets this free every empty page.
         void shrink_to_fit() override {
             _packed.shrink_to_fit();
+            _front.shrink_to_fit();
+            size_t pages = 1;
+            for (const Key key : _keys) {
+                pages = std::max(pages, static_cast<size_t>(key / chunk_size) + 1);
+            }
+            if (pages < _sparses.size()) {
+                _sparses.resize(pages);
+            }
             _sparses.shrink_to_fit();
             _keys.shrink_to_fit();
+            _membership.shrink_to_fit();
+        }
+
+        void offset_keys(Key offset) override {
+            if (offset == 0) {
+                return;
+            }
+            for (sparse& s : _sparses) {
+                s.fill(error_index);
+            }
+            _membership.clear();
+            for (size_t i = 0; i < _keys.size(); ++i) {
+                _keys[i] += offset;
+                set_index(_keys[i], i);
+            }
+            ++_version;
+        }
+
+        void remap_keys(const typename pool_t::keys_container& remap) override {
+            for (sparse& s : _sparses) {
+                s.fill(error_index);
+            }
+            _membership.clear();
+            for (size_t i = 0; i < _keys.size(); ++i) {
+                FECS_ASSERT(_keys[i] < remap.size());
+                _keys[i] = remap[_keys[i]];
+                set_index(_keys[i], i);
+            }
+            ++_version;
+        }
+
+        void append(pool_t&& other, Key offset) override {
+            auto& source = static_cast<sparse_set_template&>(other);
+
+            const size_t first = _packed.size();
+            if (first == 0) {
+                // Nothing to keep, so take the buffers as they are
+                _packed.swap(source._packed);
+                _front.swap(source._front);
+                _keys.swap(source._keys);
+                _sparses.swap(source._sparses);
+                rebuild_membership();
+                offset_keys(offset);
+            }
+            else {
+                _packed.insert(_packed.end(),
+                    std::make_move_iterator(source._packed.begin()),
+                    std::make_move_iterator(source._packed.end()));
+                if constexpr (double_buffered) {
+                    _front.insert(_front.end(),
+                        std::make_move_iterator(source._front.begin()),
+                        std::make_move_iterator(source._front.end()));
+                }
+                _keys.reserve(_packed.size());
+                for (size_t i = 0; i < source._keys.size(); ++i) {
+                    const Key key = source._keys[i] + offset;
+                    _keys.push_back(key);
+                    set_index(key, first + i);
+                }
+            }
+            for (size_t i = first; i < _keys.size(); ++i) {
+                notify_emplace(_keys[i]);
+            }
+
+            source.clear_storage();
+        }
+
+        void arrange_front(const typename pool_t::keys_container& keys) override {
+            for (size_t i = 0; i < keys.size(); ++i) {
+                const size_t index = get_index(keys[i]);
+                FECS_ASSERT(index != error_index);
+                if (index == i) {
+                    continue;
+                }
+                if constexpr (!is_tag) {
+                    std::swap(_packed[i], _packed[index]);
+                }
+                if constexpr (double_buffered) {
+                    std::swap(_front[i], _front[index]);
+                }
+                std::swap(_keys[i], _keys[index]);
+                set_index(_keys[index], index);
+                set_index(_keys[i], i);
+                ++_version;
+            }
         }
 
         template<typename Func>
         requires std::is_invocable_v<Func, T&> || std::is_invocable_v<Func, entity_t, T&>
+              || (is_tag && std::is_invocable_v<Func, entity_t>)
         void for_each(Func func){
             const size_t s = size();
             if constexpr (std::is_invocable_v<Func, T&>) {
@@ -135,6 +321,33 @@ namespace fecs {
                     func(_packed[i]);
                 }
             }
+            else if constexpr (is_tag && std::is_invocable_v<Func, entity_t>) {
+                for(size_t i = 0; i < s; ++i){
+                    func(_keys[i]);
+                }
+            }
+            else {
+                for(size_t i = 0; i < s; ++i){
+                    func(_keys[i], _packed[i]);
+                }
+            }
+        }
+
+        template<typename Func>
+        requires std::is_invocable_v<Func, const T&> || std::is_invocable_v<Func, entity_t, const T&>
+              || (is_tag && std::is_invocable_v<Func, entity_t>)
+        void for_each(Func func) const {
+            const size_t s = size();
+            if constexpr (std::is_invocable_v<Func, const T&>) {
+                for(size_t i = 0; i < s; ++i){
+                    func(_packed[i]);
+                }
+            }
+            else if constexpr (is_tag && std::is_invocable_v<Func, entity_t>) {
+                for(size_t i = 0; i < s; ++i){
+                    func(_keys[i]);
+                }
+            }
             else {
                 for(size_t i = 0; i < s; ++i){
                     func(_keys[i], _packed[i]);
@@ -152,6 +365,16 @@ namespace fecs {
             return &_packed[index];
         }
 
+        const T* get_ptr(Key key) const {
+            size_t index = get_index(key);
+
+            if(index == error_index) [[unlikely]] {
+                return nullptr;
+            }
+
+            return &_packed[index];
+        }
+
         T& get_ref(Key key) {
             size_t index = get_index(key);
 
@@ -160,6 +383,14 @@ namespace fecs {
             return _packed[index];
         }
 
+        const T& get_ref(Key key) const {
+            size_t index = get_index(key);
+
+            FECS_ASSERT(index != error_index);
+
+            return _packed[index];
+        }
+
         T& get_ref_directly_e(Key key) {
             size_t page = key / chunk_size;
             size_t offset = key % chunk_size;
@@ -167,18 +398,114 @@ namespace fecs {
             return _packed[_sparses[page][offset]];
         }
 
+        // Tags are never fetched, membership has been checked by the caller
         T& get_ref_directly_e(size_t page, size_t offset) {
-            return _packed[_sparses[page][offset]];
+            if constexpr (is_tag) {
+                return _packed.value();
+            }
+            else {
+                return _packed[_sparses[page][offset]];
+            }
+        }
+
+        const T& get_ref_directly_e(size_t page, size_t offset) const {
+            if constexpr (is_tag) {
+                return _packed.value();
+            }
+            else {
+                return _packed[_sparses[page][offset]];
+            }
         }
 
         T& get_ref_directly(size_t idx) {
             return _packed[idx];
         }
 
+        const T& get_ref_directly(size_t idx) const {
+            return _packed[idx];
+        }
+
+        // Packed values, index i belongs to get_key_by_index(i)
+        [[nodiscard]] T* data() requires (!is_tag) {
+            return std::assume_aligned<alignment>(_packed.data());
+        }
+
+        [[nodiscard]] const T* data() const requires (!is_tag) {
+            return std::assume_aligned<alignment>(_packed.data());
+        }
+
         T* get_ptr_directly(size_t idx) {
             return &_packed[idx];
         }
 
+        // Double-buffered components: writers use the usual accessors (the back buffer),
+        // readers on other threads use the front one at the same time without locks.
+        // Adding or removing components must not overlap reading the front buffer.
+
+        // Makes the values written since the last flip the front ones in O(1).
+        // The back buffer then holds the values from before that, so it suits writers
+        // that rewrite every value each frame, others should use publish.
+        // Every back value changes, so listeners such as indices see an update per key.
+        void flip() requires double_buffered {
+            _packed.swap(_front);
+            if (!_listeners.empty()) {
+                for (const Key key : _keys) {
+                    notify_update(key);
+                }
+            }
+        }
+
+        // Copies the back buffer into the front one, nothing is reallocated
+        void publish() requires double_buffered {
+            std::copy(_packed.begin(), _packed.end(), _front.begin());
+        }
+
+        [[nodiscard]] const T* get_front_ptr(Key key) const requires double_buffered {
+            const size_t index = get_index(key);
+            return index != error_index ? &_front[index] : nullptr;
+        }
+
+        [[nodiscard]] const T& get_front_ref(Key key) const requires double_buffered {
+            const size_t index = get_index(key);
+            FECS_ASSERT(index != error_index);
+            return _front[index];
+        }
+
+        template<typename Func>
+        requires double_buffered && (std::is_invocable_v<Func, const T&> || std::is_invocable_v<Func, entity_t, const T&>)
+        void for_each_front(Func func) const {
+            const size_t s = _front.size();
+            if constexpr (std::is_invocable_v<Func, const T&>) {
+                for (size_t i = 0; i < s; ++i) {
+                    func(_front[i]);
+                }
+            }
+            else {
+                for (size_t i = 0; i < s; ++i) {
+                    func(_keys[i], _front[i]);
+                }
+            }
+        }
+
+        // A lookup is two dependent loads, so it is prefetched in two steps:
+        // first the sparse slot, later the packed element that slot points to
+        void prefetch_sparse(size_t page, size_t offset) const {
+            if (page < _sparses.size()) {
+                prefetch(&_sparses[page][offset]);
+            }
+        }
+
+        void prefetch_packed(size_t page, size_t offset) const {
+            if constexpr (!is_tag) {
+                if (page < _sparses.size()) {
+                    const size_t index = _sparses[page][offset];
+                    if (index != error_index) {
+                        prefetch(&_packed[index]);
+                    }
+                }
+            }
+        }
+
         iterator begin() {
             return _packed.begin();
         }
@@ -213,7 +540,16 @@ namespace fecs {
 
     protected:
         using pool_t::_keys;
+        using pool_t::_listeners;
         using pool_t::_owner;
+        using pool_t::_membership;
+        using pool_t::_track_membership;
+        using pool_t::_version;
+        using pool_t::_removals;
+        using pool_t::rebuild_membership;
+        using pool_t::notify_emplace;
+        using pool_t::notify_update;
+        using pool_t::notify_remove;
 
         void remove_by_self(Key key) override {
             size_t index = get_index(key);
@@ -222,13 +558,21 @@ namespace fecs {
             size_t last_index = _packed.size() - 1; 
             if (index != last_index) [[likely]] {
                 std::swap(_packed[index], _packed[last_index]);
+                if constexpr (double_buffered) {
+                    std::swap(_front[index], _front[last_index]);
+                }
                 std::swap(_keys[index], _keys[last_index]);
 
                 Key moved_key = _keys[index];
                 set_index(moved_key, index);
             }
+            ++_version;
+            ++_removals;
 
             _packed.pop_back();
+            if constexpr (double_buffered) {
+                _front.pop_back();
+            }
             _keys.pop_back();
 
             set_index(key, error_index);
@@ -238,6 +582,8 @@ namespace fecs {
         static constexpr size_t error_index = std::numeric_limits<size_t>::max();
 
         packed_t _packed;
+        // Front buffer of double-buffered components, index i belongs to _keys[i] like in _packed
+        values_t _front;
         std::vector<sparse> _sparses;
 
         void set_index(Key key, size_t index){
@@ -249,6 +595,15 @@ namespace fecs {
             size_t offset = key % chunk_size;
 
             _sparses[page][offset] = index;
+
+            if (_track_membership) {
+                if (index == error_index) {
+                    _membership.reset(key);
+                }
+                else {
+                    _membership.set(key);
+                }
+            }
         }
 
         size_t get_index(Key key) const {
@@ -262,6 +617,16 @@ namespace fecs {
             return _sparses[page][offset];
         }  
 
+        void clear_storage() {
+            _packed.clear();
+            _front.clear();
+            _keys.clear();
+            _sparses.clear();
+            _membership.clear();
+            resize_sparses(1);
+            ++_version;
+        }
+
         void resize_sparses(size_t new_size){
             size_t init_size = _sparses.size();
             _sparses.resize(new_size);
@@ -278,4 +643,21 @@ namespace fecs {
     template<typename T>
     using unique_ptr_sparse_set = sparse_set_template<id_index_t, std::unique_ptr<T>>;
 
+    // Prefetches the lookups of keys[i + FECS_PREFETCH_DISTANCE] and the sparse slots
+    // of keys[i + 2 * FECS_PREFETCH_DISTANCE] in every given pool. keys[end] is never read.
+    template<typename... Pools>
+    void prefetch_lookups(const std::vector<entity_t>& keys, size_t i, size_t end, const Pools*... pools) {
+        if constexpr (FECS_PREFETCH_DISTANCE > 0 && sizeof...(Pools) > 0) {
+            constexpr size_t distance = FECS_PREFETCH_DISTANCE;
+            if (i + 2 * distance < end) {
+                const entity_t e = keys[i + 2 * distance];
+                (pools->prefetch_sparse(e / SPARSE_MAX_SIZE, e % SPARSE_MAX_SIZE), ...);
+            }
+            if (i + distance < end) {
+                const entity_t e = keys[i + distance];
+                (pools->prefetch_packed(e / SPARSE_MAX_SIZE, e % SPARSE_MAX_SIZE), ...);
+            }
+        }
+    }
+
 }
\ No newline at end of file
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "index.h"
+#include "sparse_set.h"
+#include "../core/types.h"
+
+namespace fecs {
+
+    // Uniform grid over a position component. New and removed entities are applied
+    // immediately, moved ones (patch/replace or mark_moved) are rebucketed by update().
+    // Query results are spans into an internal buffer, valid until the next query.
+    template<typename T, size_t Dims>
+    requires (Dims == 2 || Dims == 3)
+    class spatial_hash : public index_descriptor {
+    public:
+        using component_t = T;
+        using position_t = std::array<float, Dims>;
+        using projection_t = position_t(*)(const T&);
+        using pool_t = sparse_set<T>;
+
+        spatial_hash(pool_t* p, float cell_size, projection_t projection)
+            : _pool(p), _cell_size(cell_size), _inv_cell_size(1.0f / cell_size), _projection(projection) {
+            _pool->add_listener(this);
+            rebuild();
+        }
+
+        ~spatial_hash() override {
+            _pool->remove_listener(this);
+        }
+
+        spatial_hash(const spatial_hash&) = delete;
+        spatial_hash& operator=(const spatial_hash&) = delete;
+
+        // For positions written through references from for_each
+        void mark_moved(entity_t entity) {
+            entry* e = _entries.get_ptr(entity);
+            if (e != nullptr && !e->moved) {
+                e->moved = true;
+                _moved.push_back(entity);
+            }
+        }
+
+        void update() {
+            for (entity_t entity : _moved) {
+                entry* e = _entries.get_ptr(entity);
+                if (e == nullptr) {
+                    continue;
+                }
+                e->moved = false;
+                const uint64_t cell = cell_key(cell_of(position_of(entity)));
+                if (cell != e->cell) {
+                    erase(entity);
+                    insert(entity);
+                }
+            }
+            _moved.clear();
+        }
+
+        // Bounds that are NaN or infinite match nothing
+        [[nodiscard]] std::span<const entity_t> query_aabb(const position_t& min, const position_t& max) {
+            update();
+            _result.clear();
+            if (!is_finite(min) || !is_finite(max)) {
+                return _result;
+            }
+            collect(cell_of(min), cell_of(max), [&](const position_t& p) {
+                for (size_t d = 0; d < Dims; ++d) {
+                    if (!(p[d] >= min[d] && p[d] <= max[d])) {
+                        return false;
+                    }
+                }
+                return true;
+            });
+            return _result;
+        }
+
+        [[nodiscard]] std::span<const entity_t> query_radius(const position_t& center, float radius) {
+            update();
+            _result.clear();
+            if (!is_finite(center) || !std::isfinite(radius) || radius < 0.0f) {
+                return _result;
+            }
+            position_t min, max;
+            for (size_t d = 0; d < Dims; ++d) {
+                min[d] = center[d] - radius;
+                max[d] = center[d] + radius;
+            }
+            const float radius_sq = radius * radius;
+            collect(cell_of(min), cell_of(max), [&](const position_t& p) {
+                float dist_sq = 0.0f;
+                for (size_t d = 0; d < Dims; ++d) {
+                    const float delta = p[d] - center[d];
+                    dist_sq += delta * delta;
+                }
+                return dist_sq <= radius_sq;
+            });
+            return _result;
+        }
+
+        [[nodiscard]] float cell_size() const {
+            return _cell_size;
+        }
+
+        void rebuild() override {
+            _buckets.clear();
+            _entries = sparse_set<entry>();
+            _moved.clear();
+            _pool->for_each([this](entity_t e, const T&) {
+                insert(e);
+            });
+        }
+
+        void on_emplace(entity_t entity) override {
+            insert(entity);
+        }
+
+        void on_update(entity_t entity) override {
+            mark_moved(entity);
+        }
+
+        void on_remove(entity_t entity) override {
+            erase(entity);
+            _entries.remove(entity);
+        }
+
+    private:
+        using cell_t = std::array<int32_t, Dims>;
+
+        // Cells per axis that get distinct keys, coordinates are clamped to this range
+        static constexpr int64_t axis_cells = int64_t{1} << (Dims == 2 ? 32 : 21);
+        static constexpr int64_t cell_min = -axis_cells / 2;
+        static constexpr int64_t cell_max = axis_cells / 2 - 1;
+
+        struct entry {
+            uint64_t cell;
+            size_t position;
+            bool moved;
+        };
+
+        pool_t* _pool;
+        float _cell_size;
+        float _inv_cell_size;
+        projection_t _projection;
+
+        std::unordered_map<uint64_t, std::vector<entity_t>> _buckets;
+        sparse_set<entry> _entries;
+        std::vector<entity_t> _moved;
+        std::vector<entity_t> _result;
+
+        [[nodiscard]] position_t position_of(entity_t entity) const {
+            return _projection(_pool->get_ref(entity));
+        }
+
+        [[nodiscard]] static bool is_finite(const position_t& p) {
+            for (size_t d = 0; d < Dims; ++d) {
+                if (!std::isfinite(p[d])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Far away and infinite positions land in the edge cells, NaN in cell 0
+        [[nodiscard]] cell_t cell_of(const position_t& p) const {
+            cell_t c;
+            for (size_t d = 0; d < Dims; ++d) {
+                const double cell = std::floor(static_cast<double>(p[d]) * _inv_cell_size);
+                if (std::isnan(cell)) {
+                    c[d] = 0;
+                }
+                else {
+                    c[d] = static_cast<int32_t>(std::clamp(cell, static_cast<double>(cell_min), static_cast<double>(cell_max)));
+                }
+            }
+            return c;
+        }
+
+        // 32 bits per axis in 2D, 21 bits per axis in 3D
+        [[nodiscard]] static uint64_t cell_key(const cell_t& c) {
+            if constexpr (Dims == 2) {
+                return (static_cast<uint64_t>(static_cast<uint32_t>(c[0])) << 32)
+                     | static_cast<uint64_t>(static_cast<uint32_t>(c[1]));
+            }
+            else {
+                constexpr uint64_t mask = (uint64_t{1} << 21) - 1;
+                return ((static_cast<uint64_t>(c[0]) & mask) << 42)
+                     | ((static_cast<uint64_t>(c[1]) & mask) << 21)
+                     | (static_cast<uint64_t>(c[2]) & mask);
+            }
+        }
+
+        void insert(entity_t entity) {
+            const uint64_t cell = cell_key(cell_of(position_of(entity)));
+            std::vector<entity_t>& bucket = _buckets[cell];
+            entry* e = _entries.get_ptr(entity);
+            if (e != nullptr) {
+                e->cell = cell;
+                e->position = bucket.size();
+            }
+            else {
+                _entries.emplace(entity, entry{ cell, bucket.size(), false });
+            }
+            bucket.push_back(entity);
+        }
+
+        // Takes entity out of its bucket, the entry is kept
+        void erase(entity_t entity) {
+            const entry& e = _entries.get_ref(entity);
+            auto it = _buckets.find(e.cell);
+            std::vector<entity_t>& bucket = it->second;
+
+            const entity_t moved = bucket.back();
+            bucket[e.position] = moved;
+            _entries.get_ref(moved).position = e.position;
+            bucket.pop_back();
+
+            if (bucket.empty()) {
+                _buckets.erase(it);
+            }
+        }
+
+        template<typename Filter>
+        void collect(const cell_t& first, const cell_t& last, Filter filter) {
+            auto visit = [&](const std::vector<entity_t>& bucket) {
+                for (entity_t e : bucket) {
+                    if (filter(position_of(e))) {
+                        _result.push_back(e);
+                    }
+                }
+            };
+
+            // Counted in double, the product of the spans does not fit in size_t
+            double cells = 1.0;
+            bool wraps = false;
+            for (size_t d = 0; d < Dims; ++d) {
+                const int64_t span = int64_t{last[d]} - first[d] + 1;
+                if (span <= 0) {
+                    return;
+                }
+                wraps |= span >= axis_cells;
+                cells *= static_cast<double>(span);
+            }
+
+            // Large areas touch fewer occupied buckets than cells,
+            // and an axis spanning every key would visit buckets twice
+            if (wraps || cells > static_cast<double>(_buckets.size())) {
+                for (const auto& [key, bucket] : _buckets) {
+                    visit(bucket);
+                }
+                return;
+            }
+
+            cell_t c = first;
+            while (true) {
+                auto it = _buckets.find(cell_key(c));
+                if (it != _buckets.end()) {
+                    visit(it->second);
+                }
+                size_t d = 0;
+                for (; d < Dims; ++d) {
+                    if (c[d] < last[d]) {
+                        ++c[d];
+                        break;
+                    }
+                    c[d] = first[d];
+                }
+                if (d == Dims) {
+                    break;
+                }
+            }
+        }
+
+    };
+
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+namespace fecs {
+
+    // Replaces std::vector<T> as packed storage for empty types.
+    // Only the element count is stored, every index refers to the same instance.
+    template<typename T>
+    class tag_storage {
+        static_assert(std::is_empty_v<T>, "tag_storage is only meant for empty types");
+
+    public:
+        template<bool is_const>
+        class basic_iterator {
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = std::conditional_t<is_const, const T*, T*>;
+            using reference = std::conditional_t<is_const, const T&, T&>;
+
+            basic_iterator() = default;
+            basic_iterator(pointer value, size_t index)
+                : _value(value), _index(index) {}
+
+            reference operator*() const { return *_value; }
+            pointer operator->() const { return _value; }
+            reference operator[](difference_type) const { return *_value; }
+
+            basic_iterator& operator++() { ++_index; return *this; }
+            basic_iterator operator++(int) { basic_iterator tmp = *this; ++_index; return tmp; }
+            basic_iterator& operator--() { --_index; return *this; }
+            basic_iterator operator--(int) { basic_iterator tmp = *this; --_index; return tmp; }
+
+            basic_iterator& operator+=(difference_type n) { _index += n; return *this; }
+            basic_iterator& operator-=(difference_type n) { _index -= n; return *this; }
+            friend basic_iterator operator+(basic_iterator it, difference_type n) { return it += n; }
+            friend basic_iterator operator+(difference_type n, basic_iterator it) { return it += n; }
+            friend basic_iterator operator-(basic_iterator it, difference_type n) { return it -= n; }
+            friend difference_type operator-(const basic_iterator& a, const basic_iterator& b) {
+                return static_cast<difference_type>(a._index) - static_cast<difference_type>(b._index);
+            }
+
+            friend bool operator==(const basic_iterator& a, const basic_iterator& b) { return a._index == b._index; }
+            friend auto operator<=>(const basic_iterator& a, const basic_iterator& b) { return a._index <=> b._index; }
+
+        private:
+            pointer _value = nullptr;
+            size_t _index = 0;
+
+        };
+
+        using value_type = T;
+        using iterator = basic_iterator<false>;
+        using const_iterator = basic_iterator<true>;
+        using reverse_iterator = std::reverse_iterator<iterator>;
+        using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+        [[nodiscard]] size_t size() const { return _size; }
+        [[nodiscard]] bool empty() const { return _size == 0; }
+        // Nothing is allocated per element
+        [[nodiscard]] size_t capacity() const { return 0; }
+
+        void reserve(size_t) {}
+        void shrink_to_fit() {}
+        void clear() { _size = 0; }
+
+        template<typename... Args>
+        requires std::is_constructible_v<T, Args...>
+        T& emplace_back(Args&&...) {
+            ++_size;
+            return _value;
+        }
+
+        void pop_back() { --_size; }
+
+        template<typename Pos, typename It>
+        iterator insert(Pos, It first, It last) {
+            const size_t index = _size;
+            _size += static_cast<size_t>(std::distance(first, last));
+            return iterator(&_value, index);
+        }
+
+        void swap(tag_storage& other) noexcept { std::swap(_size, other._size); }
+
+        T& operator[](size_t) { return _value; }
+        const T& operator[](size_t) const { return _value; }
+
+        T& value() { return _value; }
+        const T& value() const { return _value; }
+
+        iterator begin() { return iterator(&_value, 0); }
+        iterator end() { return iterator(&_value, _size); }
+        const_iterator begin() const { return const_iterator(&_value, 0); }
+        const_iterator end() const { return const_iterator(&_value, _size); }
+        const_iterator cbegin() const { return begin(); }
+        const_iterator cend() const { return end(); }
+        reverse_iterator rbegin() { return reverse_iterator(end()); }
+        reverse_iterator rend() { return reverse_iterator(begin()); }
+        const_reverse_iterator crbegin() const { return const_reverse_iterator(end()); }
+        const_reverse_iterator crend() const { return const_reverse_iterator(begin()); }
+
+    private:
+        [[no_unique_address]] T _value{};
+        size_t _size = 0;
+
+    };
+
+}
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "entity_allocator.h"
+#include "type_index.h"
+#include "type_traits.h"
+#include "types.h"
+#include "../containers/archetype.h"
+#include "../containers/sparse_set.h"
+#include "../queues/archetype_view.h"
+#include "../util/log.h"
+#include "../util/profile.h"
+
+namespace fecs {
+
+    // Storage engine with the registry component API where entities with the same set
+    // of components share a table. Every view iterates contiguous columns, in exchange
+    // adding or removing a component moves the whole entity to another table.
+    // Suits worlds with a few stable component combinations.
+    class archetype_registry {
+    public:
+        archetype_registry() {
+            _archetypes.push_back(std::make_unique<archetype>());
+            _by_types.emplace(std::vector<id_index_t>{}, _archetypes.front().get());
+        }
+
+        archetype_registry(const archetype_registry&) = delete;
+        archetype_registry& operator=(const archetype_registry&) = delete;
+
+        // Entities management
+
+        entity_t create_entity() {
+            const entity_t entity = _entities.create();
+            archetype* root = _archetypes.front().get();
+            _locations.emplace(entity, location{ root, root->push_entity(entity) });
+            return entity;
+        }
+
+        void destroy_entity(entity_t entity) {
+            FECS_PROFILE_SCOPE("fecs::archetype_registry::destroy_entity");
+            const location* loc = _locations.get_ptr(entity);
+            if (loc == nullptr) {
+                return;
+            }
+            erase_row(*loc);
+            _locations.remove(entity);
+            _entities.release(entity);
+        }
+
+        // Components management
+
+        template<typename Component, typename... Args>
+        requires std::is_constructible_v<Component, Args&&...>
+        void add_component(entity_t entity, Args&&... args) {
+            location& loc = get_location(entity);
+            const id_index_t id = type_index<Component>::value();
+            if (loc.table->has(id)) {
+                loc.table->template get_column<Component>()[loc.row] = Component(std::forward<Args>(args)...);
+                return;
+            }
+
+            archetype* target = loc.table->add_edge(id);
+            if (target == nullptr) {
+                target = find_or_create_with<Component>(*loc.table);
+                loc.table->set_add_edge(id, target);
+            }
+            const location old = loc;
+            const size_t row = old.table->move_row(old.row, *target);
+            target->template get_column<Component>().emplace_back(std::forward<Args>(args)...);
+            loc = location{ target, row };
+            erase_row(old);
+        }
+
+        template<typename Component, typename... Args>
+        requires std::is_constructible_v<Component, Args&&...>
+        void add_component(const std::vector<entity_t>& entities, Args&&... args) {
+            for (entity_t entity : entities) {
+                add_component<Component>(entity, args...);
+            }
+        }
+
+        template<typename Component>
+        void remove_component(entity_t entity) {
+            location* loc = _locations.get_ptr(entity);
+            const id_index_t id = type_index<Component>::value();
+            if (loc == nullptr || !loc->table->has(id)) {
+                return;
+            }
+
+            archetype* target = loc->table->remove_edge(id);
+            if (target == nullptr) {
+                target = find_or_create_without(*loc->table, id);
+                loc->table->set_remove_edge(id, target);
+            }
+            const location old = *loc;
+            const size_t row = old.table->move_row(old.row, *target);
+            *loc = location{ target, row };
+            erase_row(old);
+        }
+
+        template<typename Component>
+        void remove_component(const std::vector<entity_t>& entities) {
+            for (entity_t entity : entities) {
+                remove_component<Component>(entity);
+            }
+        }
+
+        template<typename... Components>
+        void remove_components(entity_t entity) {
+            (remove_component<Components>(entity), ...);
+        }
+
+        template<typename Component, typename Func>
+        requires std::is_invocable_v<Func, Component&>
+        void patch(entity_t entity, Func func) {
+            const location& loc = get_location(entity);
+            FECS_ASSERT(loc.table->has(type_index<Component>::value()));
+            func(loc.table->template get_column<Component>()[loc.row]);
+        }
+
+        template<typename Component, typename... Args>
+        requires std::is_constructible_v<Component, Args&&...>
+        void replace(entity_t entity, Args&&... args) {
+            patch<Component>(entity, [&](Component& value) { value = Component(std::forward<Args>(args)...); });
+        }
+
+        template<typename Component>
+        bool has_component(entity_t entity) const {
+            const location* loc = _locations.get_ptr(entity);
+            return loc != nullptr && loc->table->has(type_index<Component>::value());
+        }
+
+        // Different 'iterators'
+
+        template<typename... Ts>
+        requires unique_types<Ts...> && (sizeof...(Ts) > 0)
+        archetype_view<Ts...> view() {
+            using view_t = archetype_view<Ts...>;
+            const id_index_t id_index = type_index<view_t>::value();
+
+            std::unique_ptr<archetype_matches>* matches = _matches.get_ptr(id_index);
+            if (matches == nullptr) {
+                const size_t index = _matches.emplace(id_index,
+                    std::make_unique<archetype_matches>(std::vector<id_index_t>{ type_index<Ts>::value()... }));
+                matches = &_matches.get_ref_directly(index);
+            }
+            (*matches)->refresh(_archetypes);
+            return view_t(matches->get(), &_archetypes);
+        }
+
+        template<typename T>
+        archetype_view<T> runner() {
+            return view<T>();
+        }
+
+        template<typename T, typename Func>
+        requires std::is_invocable_v<Func, T&> || std::is_invocable_v<Func, entity_t, T&>
+        void direct_for_each(Func func) {
+            view<T>().for_each(func);
+        }
+
+        // Other
+
+        [[nodiscard]] size_t archetype_count() const {
+            return _archetypes.size();
+        }
+
+        void shrink_to_fit() {
+            for (auto& a : _archetypes) {
+                a->shrink_to_fit();
+            }
+            _locations.shrink_to_fit();
+        }
+
+    private:
+        struct location {
+            archetype* table;
+            size_t row;
+        };
+
+        entity_allocator _entities;
+        sparse_set<location> _locations;
+        // Tables are only ever added, their addresses stay valid
+        std::vector<std::unique_ptr<archetype>> _archetypes;
+        std::map<std::vector<id_index_t>, archetype*> _by_types;
+        unique_ptr_sparse_set<archetype_matches> _matches;
+
+        location& get_location(entity_t entity) {
+            location* loc = _locations.get_ptr(entity);
+            FECS_ASSERT_M(loc != nullptr, "Entity was not created by this archetype_registry");
+            return *loc;
+        }
+
+        // Removes the row of a location and patches the entity that took its place
+        void erase_row(const location& loc) {
+            const entity_t moved = loc.table->swap_remove(loc.row);
+            if (moved != error_entity) {
+                _locations.get_ref(moved).row = loc.row;
+            }
+        }
+
+        template<typename Component>
+        archetype* find_or_create_with(const archetype& base) {
+            const id_index_t id = type_index<Component>::value();
+            std::vector<id_index_t> types = base.types();
+            types.insert(std::lower_bound(types.begin(), types.end(), id), id);
+
+            auto it = _by_types.find(types);
+            if (it != _by_types.end()) {
+                return it->second;
+            }
+            _archetypes.push_back(std::make_unique<archetype>(base, id, std::make_unique<column<Component>>()));
+            archetype* created = _archetypes.back().get();
+            _by_types.emplace(std::move(types), created);
+            return created;
+        }
+
+        archetype* find_or_create_without(const archetype& base, id_index_t id) {
+            std::vector<id_index_t> types = base.types();
+            types.erase(std::find(types.begin(), types.end(), id));
+
+            auto it = _by_types.find(types);
+            if (it != _by_types.end()) {
+                return it->second;
+            }
+            _archetypes.push_back(std::make_unique<archetype>(base, id));
+            archetype* created = _archetypes.back().get();
+            _by_types.emplace(std::move(types), created);
+            return created;
+        }
+
+    };
+
+}
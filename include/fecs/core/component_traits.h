@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+
+namespace fecs {
+
+    // Per-component storage options, specialize it for a component to change them:
+    //
+    //     template<>
+    //     struct fecs::component_traits<transform> : fecs::component_traits<> {
+    //         static constexpr bool double_buffered = true;
+    //     };
+    template<typename T = void>
+    struct component_traits {
+        // The pool keeps a second, front copy of the values for readers on other threads,
+        // see sparse_set::flip
+        static constexpr bool double_buffered = false;
+        // Alignment of the packed values in bytes, 0 keeps alignof(T).
+        // E.g. 32 for aligned AVX loads or 64 for whole cache lines.
+        static constexpr size_t alignment = 0;
+    };
+
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "type_index.h"
+#include "../util/log.h"
+
+namespace fecs {
+
+    namespace details {
+
+        // Separate from type_index so that context slots stay dense
+        struct context_index final {
+            [[nodiscard]] static id_index_t next() noexcept {
+                static id_index_t value{};
+                return value++;
+            }
+        };
+
+    }
+
+    template<typename T>
+    struct context_index final {
+        [[nodiscard]] static id_index_t value() noexcept {
+            static const id_index_t value = details::context_index::next();
+            return value;
+        }
+    };
+
+    // Registry-wide singletons (frame clock, input, settings...).
+    // Every type has its own slot, so access is a single indexed load.
+    class context {
+    public:
+        template<typename T, typename... Args>
+        requires std::is_constructible_v<T, Args&&...>
+        T& emplace(Args&&... args) {
+            const id_index_t index = context_index<T>::value();
+            if (index >= _slots.size()) {
+                _slots.resize(index + 1);
+            }
+            _slots[index] = slot(new T(std::forward<Args>(args)...), slot_deleter{ &destroy<T> });
+            return *static_cast<T*>(_slots[index].get());
+        }
+
+        template<typename T>
+        [[nodiscard]] T* find() {
+            const id_index_t index = context_index<T>::value();
+            return index < _slots.size() ? static_cast<T*>(_slots[index].get()) : nullptr;
+        }
+
+        template<typename T>
+        [[nodiscard]] const T* find() const {
+            const id_index_t index = context_index<T>::value();
+            return index < _slots.size() ? static_cast<const T*>(_slots[index].get()) : nullptr;
+        }
+
+        template<typename T>
+        [[nodiscard]] T& get() {
+            T* value = find<T>();
+            FECS_ASSERT_M(value != nullptr, "Before using context::get you have to context::emplace");
+            return *value;
+        }
+
+        template<typename T>
+        [[nodiscard]] const T& get() const {
+            const T* value = find<T>();
+            FECS_ASSERT_M(value != nullptr, "Before using context::get you have to context::emplace");
+            return *value;
+        }
+
+        template<typename T>
+        [[nodiscard]] bool contains() const {
+            return find<T>() != nullptr;
+        }
+
+        template<typename T>
+        void erase() {
+            const id_index_t index = context_index<T>::value();
+            if (index < _slots.size()) {
+                _slots[index].reset();
+            }
+        }
+
+    private:
+        struct slot_deleter {
+            void (*destroy)(void*) = nullptr;
+
+            void operator()(void* p) const {
+                destroy(p);
+            }
+        };
+
+        using slot = std::unique_ptr<void, slot_deleter>;
+
+        std::vector<slot> _slots;
+
+        template<typename T>
+        static void destroy(void* p) {
+            delete static_cast<T*>(p);
+        }
+
+    };
+
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "types.h"
+#include "../containers/dense_bitset.h"
+
+namespace fecs {
+
+    // Hands out entity ids.
+    // reserve() and take() are lock-free and can be called from any thread,
+    // create() and release() belong to the thread that owns the registry.
+    class entity_allocator {
+    public:
+        // Range of ids owned by one worker, refilled by take()
+        struct block {
+            entity_t next = 0;
+            entity_t end = 0;
+        };
+
+        static constexpr entity_t default_block_size = 256;
+
+        entity_allocator() = default;
+
+        entity_allocator(entity_allocator&& other) noexcept
+            : _counter(other._counter.load(std::memory_order_relaxed)),
+              _free(std::move(other._free)),
+              _released(std::move(other._released)),
+              _recycling(other._recycling) {}
+
+        entity_allocator& operator=(entity_allocator&& other) noexcept {
+            _counter.store(other._counter.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            _free = std::move(other._free);
+            _released = std::move(other._released);
+            _recycling = other._recycling;
+            return *this;
+        }
+
+        entity_t create() {
+            if (_recycling && !_free.empty()) {
+                const entity_t entity = _free.back();
+                _free.pop_back();
+                _released.reset(entity);
+                return entity;
+            }
+            return _counter.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Ids that were never handed out or are already free are ignored,
+        // so destroying an entity twice can not hand its id out twice
+        void release(entity_t entity) {
+            if (!_recycling || entity >= size() || _released.test(entity)) {
+                return;
+            }
+            _released.set(entity);
+            _free.push_back(entity);
+        }
+
+        // Returns the first of count fresh ids. Recycled ids are never returned here.
+        entity_t reserve(entity_t count) {
+            return _counter.fetch_add(count, std::memory_order_relaxed);
+        }
+
+        entity_t take(block& b, entity_t block_size = default_block_size) {
+            if (b.next == b.end) {
+                b.next = reserve(block_size);
+                b.end = b.next + block_size;
+            }
+            return b.next++;
+        }
+
+        // Upper bound of all ids handed out so far
+        [[nodiscard]] entity_t size() const {
+            return _counter.load(std::memory_order_relaxed);
+        }
+
+        // Ids [0, size) are in use and none is free, e.g. after the registry renumbered its entities.
+        // Must not run concurrently with reserve() or take().
+        void reset(entity_t size) {
+            _counter.store(size, std::memory_order_relaxed);
+            _free.clear();
+            _released.clear();
+        }
+
+        void set_recycling(bool recycling) {
+            _recycling = recycling;
+            if (!recycling) {
+                _free.clear();
+                _released.clear();
+            }
+        }
+
+        [[nodiscard]] bool is_recycling() const {
+            return _recycling;
+        }
+
+    private:
+        std::atomic<entity_t> _counter = 0;
+        std::vector<entity_t> _free;
+        // Ids currently in _free
+        dense_bitset _released;
+        bool _recycling = false;
+
+    };
+
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "types.h"
+#include "../containers/sparse_set.h"
+#include "../util/log.h"
+
+namespace fecs {
+
+    // Intrusive parent/child links, children of one parent form a doubly linked list
+    struct relationship {
+        entity_t parent = error_entity;
+        entity_t first_child = error_entity;
+        entity_t next_sibling = error_entity;
+        entity_t prev_sibling = error_entity;
+        uint32_t depth = 0;
+    };
+
+    enum class hierarchy_order : uint8_t {
+        depth_first,
+        breadth_first
+    };
+
+    // Keeps the relationship pool ordered so that every parent is stored before its children.
+    // Component pools can be aligned to the same order, then a hierarchical pass reads them linearly.
+    class hierarchy {
+    public:
+        using pool_t = sparse_set<relationship>;
+
+        void attach(pool_t& rels, entity_t child, entity_t parent) {
+            FECS_ASSERT_M(rels.get_owner() == nullptr, "Relationship pool can't be owned by a group");
+            FECS_ASSERT_M(child != parent, "Entity can't be its own parent");
+
+            rels.try_emplace(child);
+            rels.try_emplace(parent);
+
+            for (entity_t e = parent; e != error_entity; e = rels.get_ref(e).parent) {
+                if (e == child) {
+                    FECS_ASSERT_M(false, "Hierarchy cycle: parent is a descendant of child");
+                    return;
+                }
+            }
+
+            if (rels.get_ref(child).parent == parent) {
+                return;
+            }
+            detach(rels, child);
+
+            relationship& p = rels.get_ref(parent);
+            relationship& c = rels.get_ref(child);
+            c.parent = parent;
+            c.next_sibling = p.first_child;
+            if (p.first_child != error_entity) {
+                rels.get_ref(p.first_child).prev_sibling = child;
+            }
+            p.first_child = child;
+
+            set_depth(rels, child, p.depth + 1);
+            _dirty = true;
+        }
+
+        void detach(pool_t& rels, entity_t child) {
+            relationship* c = rels.get_ptr(child);
+            if (c == nullptr || c->parent == error_entity) {
+                return;
+            }
+
+            if (c->prev_sibling != error_entity) {
+                rels.get_ref(c->prev_sibling).next_sibling = c->next_sibling;
+            }
+            else {
+                rels.get_ref(c->parent).first_child = c->next_sibling;
+            }
+            if (c->next_sibling != error_entity) {
+                rels.get_ref(c->next_sibling).prev_sibling = c->prev_sibling;
+            }
+            c->parent = error_entity;
+            c->prev_sibling = error_entity;
+            c->next_sibling = error_entity;
+
+            set_depth(rels, child, 0);
+            _dirty = true;
+        }
+
+        // Unlinks entity from its parent and turns its children into roots.
+        // The relationship itself is left for the caller to remove.
+        void release(pool_t& rels, entity_t entity) {
+            relationship* r = rels.get_ptr(entity);
+            if (r == nullptr) {
+                return;
+            }
+            detach(rels, entity);
+
+            entity_t child = rels.get_ref(entity).first_child;
+            while (child != error_entity) {
+                relationship& c = rels.get_ref(child);
+                const entity_t next = c.next_sibling;
+                c.parent = error_entity;
+                c.prev_sibling = error_entity;
+                c.next_sibling = error_entity;
+                set_depth(rels, child, 0);
+                child = next;
+            }
+            rels.get_ref(entity).first_child = error_entity;
+            _dirty = true;
+        }
+
+        // Reorders the relationship pool so that parents come before children.
+        // Returns false if it was already sorted in this order.
+        bool sort(pool_t& rels, hierarchy_order order) {
+            if (!_dirty && order == _order && rels.version() == _sorted_version) {
+                return false;
+            }
+            FECS_ASSERT_M(rels.get_owner() == nullptr, "Relationship pool can't be owned by a group");
+
+            _order = order;
+            _dirty = false;
+            _scratch.clear();
+            _scratch.reserve(rels.size());
+
+            const auto& keys = rels.get_keys();
+            for (entity_t e : keys) {
+                if (rels.get_ref(e).parent == error_entity) {
+                    _scratch.push_back(e);
+                }
+            }
+
+            if (order == hierarchy_order::breadth_first) {
+                for (size_t i = 0; i < _scratch.size(); ++i) {
+                    for (entity_t c = rels.get_ref(_scratch[i]).first_child; c != error_entity; c = rels.get_ref(c).next_sibling) {
+                        _scratch.push_back(c);
+                    }
+                }
+            }
+            else {
+                // Roots are expanded in place: each one is followed by its whole subtree
+                std::vector<entity_t> stack(_scratch.rbegin(), _scratch.rend());
+                _scratch.clear();
+                while (!stack.empty()) {
+                    const entity_t e = stack.back();
+                    stack.pop_back();
+                    _scratch.push_back(e);
+
+                    const size_t first = stack.size();
+                    for (entity_t c = rels.get_ref(e).first_child; c != error_entity; c = rels.get_ref(c).next_sibling) {
+                        stack.push_back(c);
+                    }
+                    std::reverse(stack.begin() + static_cast<std::ptrdiff_t>(first), stack.end());
+                }
+            }
+
+            for (size_t i = 0; i < _scratch.size(); ++i) {
+                rels.swap(keys[i], _scratch[i]);
+            }
+            _sorted_version = rels.version();
+            _aligned.clear();
+            return true;
+        }
+
+        // Moves the entities of p that have a relationship to its front, in hierarchy order.
+        // Returns false if p is owned by a group and can't be reordered.
+        bool align(const pool_t& rels, pool& p) {
+            if (p.get_owner() != nullptr) {
+                return false;
+            }
+            size_t next = 0;
+            for (entity_t e : rels.get_keys()) {
+                if (p.contains(e)) {
+                    p.swap(p.get_key_by_index(next), e);
+                    next++;
+                }
+            }
+            auto it = std::find_if(_aligned.begin(), _aligned.end(), [&p](const aligned_pool& a) { return a.p == &p; });
+            if (it == _aligned.end()) {
+                it = _aligned.insert(_aligned.end(), aligned_pool{ &p });
+            }
+            it->version = p.version();
+            it->size = p.size();
+            return true;
+        }
+
+        // True if p is still in the order of the last align, removals and appends break it
+        [[nodiscard]] bool is_aligned(const pool& p) const {
+            return std::any_of(_aligned.begin(), _aligned.end(), [&p](const aligned_pool& a) {
+                return a.p == &p && a.version == p.version() && a.size == p.size();
+            });
+        }
+
+        void mark_dirty() {
+            _dirty = true;
+        }
+
+        [[nodiscard]] hierarchy_order order() const {
+            return _order;
+        }
+
+    private:
+        struct aligned_pool {
+            const pool* p = nullptr;
+            uint64_t version = 0;
+            size_t size = 0;
+        };
+
+        std::vector<entity_t> _scratch;
+        std::vector<aligned_pool> _aligned;
+        uint64_t _sorted_version = 0;
+        hierarchy_order _order = hierarchy_order::depth_first;
+        bool _dirty = true;
+
+        void set_depth(pool_t& rels, entity_t root, uint32_t depth) {
+            std::vector<entity_t> stack{ root };
+            rels.get_ref(root).depth = depth;
+            while (!stack.empty()) {
+                const entity_t e = stack.back();
+                stack.pop_back();
+                const uint32_t child_depth = rels.get_ref(e).depth + 1;
+                for (entity_t c = rels.get_ref(e).first_child; c != error_entity; c = rels.get_ref(c).next_sibling) {
+                    rels.get_ref(c).depth = child_depth;
+                    stack.push_back(c);
+                }
+            }
+        }
+
+    };
+
+}
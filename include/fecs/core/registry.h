@@ -1,36 +1,140 @@
 #pragma once
 
+#include <array>
 #include <cassert>
 #include <type_traits>
 #include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 #include "type_traits.h"
 #include "types.h"
+#include "entity_allocator.h"
+#include "context.h"
+#include "hierarchy.h"
 #include "../containers/sparse_set.h"
+#include "../containers/index.h"
+#include "../containers/spatial_hash.h"
 #include "../core/type_index.h"
 #include "../queues/group.h"
 #include "../queues/view.h"
+#include "../queues/query.h"
 #include "../queues/runner.h"
 #include "../queues/group_slice.h"
+#include "../queues/read_only.h"
 #include "../util/log.h"
+#include "../util/profile.h"
+#include "../util/stats.h"
 
 namespace fecs {
 
     class registry{
     public:
+        registry() = default;
+
+        // Pools live on the heap, so indices moved along keep pointing at them
+        registry(registry&&) noexcept = default;
+
+        // Indices unregister from their pools when destroyed, so the old ones
+        // have to go while the pools they listen to are still alive
+        registry& operator=(registry&& other) noexcept {
+            if (this != &other) {
+                _indices = std::move(other._indices);
+                _queries = std::move(other._queries);
+                _groups = std::move(other._groups);
+                _pools = std::move(other._pools);
+                _entities = std::move(other._entities);
+                _context = std::move(other._context);
+                _hierarchy = std::move(other._hierarchy);
+            }
+            return *this;
+        }
 
         // Entities management
 
         entity_t create_entity() {
-            return _entity_counter++;
+            return _entities.create();
         }
 
         void destroy_entity(entity_t entity) {
+            FECS_PROFILE_SCOPE("fecs::registry::destroy_entity");
+            if (sparse_set<relationship>* rels = find_relationships()) {
+                _hierarchy.release(*rels, entity);
+            }
             for (const auto& p : _pools) {
                 if (p->contains(entity)) {
                     p->remove(entity);
                 }
             }
+            _entities.release(entity);
+        }
+
+        // Thread-safe, returns the first of count consecutive fresh ids
+        entity_t reserve_entities(entity_t count) {
+            return _entities.reserve(count);
+        }
+
+        // Workers may call reserve() and take() on it concurrently
+        entity_allocator& entities() {
+            return _entities;
+        }
+
+        void set_entity_recycling(bool recycling) {
+            _entities.set_recycling(recycling);
+        }
+
+        // Moves every entity of staging into this registry. Staging entities get a contiguous
+        // block of new ids starting at the returned value (staging entity e becomes base + e).
+        // Pools missing here are taken over as they are, others are appended in bulk.
+        // Groups of staging are dropped, groups of this registry are repacked once.
+        entity_t merge(registry&& staging) {
+            FECS_PROFILE_SCOPE("fecs::registry::merge");
+            // Staging indices listen to pools that are about to move
+            staging._indices = unique_ptr_sparse_set<index_descriptor>();
+            const entity_t count = staging._entities.size();
+            if (count == 0) {
+                return _entities.size();
+            }
+            const entity_t base = _entities.reserve(count);
+
+            if (sparse_set<relationship>* rels = staging.find_relationships()) {
+                rels->for_each([base](relationship& r) {
+                    for (entity_t* e : { &r.parent, &r.first_child, &r.next_sibling, &r.prev_sibling }) {
+                        if (*e != error_entity) {
+                            *e += base;
+                        }
+                    }
+                });
+                _hierarchy.mark_dirty();
+            }
+
+            const auto& ids = staging._pools.get_keys();
+            for (size_t i = 0; i < ids.size(); ++i) {
+                std::unique_ptr<pool>& source = staging._pools.get_ref_directly(i);
+                source->detach_owner();
+
+                std::unique_ptr<pool>* target = _pools.get_ptr(ids[i]);
+                if (target == nullptr) {
+                    source->offset_keys(base);
+                    _pools.emplace(ids[i], std::move(source));
+                }
+                else {
+                    (*target)->append(std::move(*source), base);
+                }
+            }
+
+            for (auto& g_uptr : _groups) {
+                for (id_index_t id : ids) {
+                    if (g_uptr->own(id)) {
+                        g_uptr->pack_pools();
+                        break;
+                    }
+                }
+            }
+
+            staging = registry{};
+            return base;
         }
 
         // Pools management
@@ -45,6 +149,7 @@ namespace fecs {
         template<typename Component, typename... Args>
         requires std::is_constructible_v<Component, Args&&...>
         void add_component(entity_t entity, Args&&... args) {
+            static_assert(!std::is_same_v<Component, relationship>, "Relationships are changed through set_parent and remove_parent");
             using sparse_t = sparse_set<Component>;
 
             pool* pool_ptr = find_or_create_pool<Component>();
@@ -58,6 +163,7 @@ namespace fecs {
         template<typename Component, typename... Args>
         requires std::is_constructible_v<Component, Args&&...>
         void add_component_directly(entity_t entity, Args&&... args) {
+            static_assert(!std::is_same_v<Component, relationship>, "Relationships are changed through set_parent and remove_parent");
             using sparse_t = sparse_set<Component>;
 
             sparse_t* sparse_ptr = static_cast<sparse_t*>(_pools.get_ptr(type_index<Component>::value())->get());
@@ -68,6 +174,7 @@ namespace fecs {
         template<typename Component, typename... Args>
         requires std::is_constructible_v<Component, Args&&...>
         void add_component(const std::vector<entity_t>& entities, Args&&... args) {
+            static_assert(!std::is_same_v<Component, relationship>, "Relationships are changed through set_parent and remove_parent");
             using sparse_t = sparse_set<Component>;
 
             create_pool<Component>();
@@ -80,6 +187,7 @@ namespace fecs {
 
         template<typename Component>
         void remove_component(entity_t entity){
+            static_assert(!std::is_same_v<Component, relationship>, "Relationships are changed through set_parent and remove_parent");
             auto p = find_pool<Component>();
             if(p != nullptr){
                 p->remove(entity);
@@ -88,6 +196,7 @@ namespace fecs {
 
         template<typename Component>
         void remove_component(const std::vector<entity_t>& entities){
+            static_assert(!std::is_same_v<Component, relationship>, "Relationships are changed through set_parent and remove_parent");
             auto p = find_pool<Component>();
             if(p == nullptr){
                 return;
@@ -101,17 +210,39 @@ namespace fecs {
         // This is unsafe if the pool of Component types does not exist.
         template<typename Component>
         void remove_component_directly(entity_t entity){
+            static_assert(!std::is_same_v<Component, relationship>, "Relationships are changed through set_parent and remove_parent");
             auto p = find_pool<Component>();
             p->remove(entity);
         }
 
+        // Modifies a component so that indices over it are updated
+        template<typename Component, typename Func>
+        requires std::is_invocable_v<Func, Component&>
+        void patch(entity_t entity, Func func) {
+            static_assert(!std::is_same_v<Component, relationship>, "Relationships are changed through set_parent and remove_parent");
+            find_pool<Component>()->patch(entity, func);
+        }
+
+        template<typename Component, typename... Args>
+        requires std::is_constructible_v<Component, Args&&...>
+        void replace(entity_t entity, Args&&... args) {
+            static_assert(!std::is_same_v<Component, relationship>, "Relationships are changed through set_parent and remove_parent");
+            find_pool<Component>()->replace(entity, std::forward<Args>(args)...);
+        }
+
         template<typename... Components>
         void remove_components(entity_t entity) {
             (remove_component<Components>(entity), ...);
         }
 
+        // Lets views over tracked components intersect membership bitsets instead of probing sparse pages
         template<typename Component>
-        bool has_component(entity_t entity) {
+        void set_membership_tracking(bool enabled = true) {
+            find_or_create_pool<Component>()->set_membership_tracking(enabled);
+        }
+
+        template<typename Component>
+        bool has_component(entity_t entity) const {
             auto p = find_pool<Component>();
             if (p == nullptr) {
                 return false;
@@ -214,6 +345,18 @@ namespace fecs {
             return nullptr;
         }
 
+        template<typename... Ts>
+        requires unique_types<Ts...> && (sizeof...(Ts) > 1)
+        const fecs::group<pack_part<Ts...>, view_part<>>* group() const {
+            return const_cast<registry*>(this)->group<Ts...>();
+        }
+
+        template<typename... PTs, typename... VTs>
+        requires unique_types<PTs..., VTs...> && (sizeof...(PTs) > 1)
+        const fecs::group<pack_part<PTs...>, view_part<VTs...>>* group(view_part<VTs...>) const {
+            return const_cast<registry*>(this)->group<PTs...>(view_part<VTs...>{});
+        }
+
         template<typename... Ts>
         requires unique_types<Ts...> && (sizeof...(Ts) > 1)
         fecs::view<Ts...> view() {
@@ -223,11 +366,84 @@ namespace fecs {
             return view_t(arr);
         }
 
+        template<typename... Ts>
+        requires unique_types<Ts...> && (sizeof...(Ts) > 1)
+        read_only<fecs::view<Ts...>> view() const {
+            return read_only(const_cast<registry*>(this)->view<Ts...>());
+        }
+
+        // Returns the index over Member, building it on first use.
+        // Changes made through references from for_each are not seen, use patch or replace.
+        template<auto Member, template<auto> class Index = hash_index>
+        Index<Member>& index() {
+            using index_t = Index<Member>;
+            using component_t = typename index_t::component_t;
+            const id_index_t id_index = type_index<index_t>::value();
+
+            std::unique_ptr<index_descriptor>* i_uptr = _indices.get_ptr(id_index);
+            if (i_uptr != nullptr) {
+                return *static_cast<index_t*>(i_uptr->get());
+            }
+
+            auto p = static_cast<sparse_set<component_t>*>(find_or_create_pool<component_t>());
+            const size_t index = _indices.emplace(id_index, std::make_unique<index_t>(p));
+
+            return *static_cast<index_t*>(_indices.get_ref_directly(index).get());
+        }
+
+        // projection maps the component to a point, a captureless lambda is enough
+        template<typename T, size_t Dims = 3>
+        fecs::spatial_hash<T, Dims>& create_spatial_index(float cell_size, typename fecs::spatial_hash<T, Dims>::projection_t projection) {
+            using index_t = fecs::spatial_hash<T, Dims>;
+            const id_index_t id_index = type_index<index_t>::value();
+
+            FECS_ASSERT_M(!_indices.contains(id_index), "Spatial index for this component already exists");
+
+            auto p = static_cast<sparse_set<T>*>(find_or_create_pool<T>());
+            const size_t index = _indices.emplace(id_index, std::make_unique<index_t>(p, cell_size, projection));
+
+            return *static_cast<index_t*>(_indices.get_ref_directly(index).get());
+        }
+
+        template<typename T, size_t Dims = 3>
+        fecs::spatial_hash<T, Dims>* spatial_index() {
+            using index_t = fecs::spatial_hash<T, Dims>;
+            std::unique_ptr<index_descriptor>* i_uptr = _indices.get_ptr(type_index<index_t>::value());
+            if (i_uptr != nullptr) {
+                return static_cast<index_t*>(i_uptr->get());
+            }
+            FECS_ASSERT_M(false, "Before using registry::spatial_index you have to registry::create_spatial_index");
+            return nullptr;
+        }
+
+        // Returns a registry-owned query that keeps its pools and plan between calls
+        template<typename... Ts>
+        requires unique_types<Ts...> && (sizeof...(Ts) > 1)
+        fecs::query<Ts...>& query() {
+            using query_t = fecs::query<Ts...>;
+            const id_index_t id_index = type_index<query_t>::value();
+
+            std::unique_ptr<query_descriptor>* q_uptr = _queries.get_ptr(id_index);
+            if (q_uptr != nullptr) {
+                return *static_cast<query_t*>(q_uptr->get());
+            }
+
+            typename query_t::pools_array arr { find_or_create_pool<Ts>()... };
+            const size_t index = _queries.emplace(id_index, std::make_unique<query_t>(arr));
+
+            return *static_cast<query_t*>(_queries.get_ref_directly(index).get());
+        }
+
         template<typename T>
         fecs::runner<T> runner(){
             return fecs::runner<T>(find_pool<T>());
         }
 
+        template<typename T>
+        read_only<fecs::runner<T>> runner() const {
+            return read_only(const_cast<registry*>(this)->runner<T>());
+        }
+
         template<typename... Ts>
         requires unique_types<Ts...> && (sizeof...(Ts) > 1)
         fecs::group_slice<pack_part<Ts...>, view_part<>> group_slice(queue_args_descriptor<pack_part<Ts...>, view_part<>>) {
@@ -245,17 +461,17 @@ namespace fecs {
         fecs::group_slice<pack_part<Ts...>, view_part<>> group_slice() {
             using slice_t = fecs::group_slice<pack_part<Ts...>, view_part<>>;
 
-            const size_t* ni = nullptr;
+            group_descriptor* owner = nullptr;
             for (const auto& g : _groups) {
                 if (g->own_all<Ts...>()) {
-                    ni = g->get_next_index_ptr();
+                    owner = g.get();
                     break;
                 }
             }
 
-            if (ni) {
+            if (owner) {
                 typename slice_t::p_pools_array arr { find_pool<Ts>()... };
-                return slice_t(arr, ni);
+                return slice_t(arr, owner);
             }
             throw std::runtime_error("No group owns the components from which you are trying to make a slice.");
         }
@@ -265,28 +481,139 @@ namespace fecs {
         fecs::group_slice<pack_part<PTs...>, view_part<VTs...>> group_slice(view_part<VTs...>) {
             using slice_t = fecs::group_slice<pack_part<PTs...>, view_part<VTs...>>;
 
-            const size_t* ni = nullptr;
+            group_descriptor* owner = nullptr;
             for (const auto& g : _groups) {
                 if (g->own_all<PTs...>()) {
-                    ni = g->get_next_index_ptr();
+                    owner = g.get();
                     break;
                 }
             }
 
-            if (ni) {
+            if (owner) {
                 typename slice_t::p_pools_array p_arr { find_pool<PTs>()... };
                 typename slice_t::v_pools_array v_arr { find_pool<VTs>()... };
-                return slice_t(p_arr, v_arr, ni);
+                return slice_t(p_arr, v_arr, owner);
             }
             throw std::runtime_error("No group owns the components from which you are trying to make a slice.");
         }
 
+        template<typename... Ts>
+        requires unique_types<Ts...> && (sizeof...(Ts) > 1)
+        read_only<fecs::group_slice<pack_part<Ts...>, view_part<>>> group_slice() const {
+            return read_only(const_cast<registry*>(this)->group_slice<Ts...>());
+        }
+
+        template<typename... PTs, typename... VTs>
+        requires unique_types<PTs..., VTs...> && (sizeof...(PTs) > 1)
+        read_only<fecs::group_slice<pack_part<PTs...>, view_part<VTs...>>> group_slice(view_part<VTs...>) const {
+            return read_only(const_cast<registry*>(this)->group_slice<PTs...>(view_part<VTs...>{}));
+        }
+
         template<typename T, typename Func>
         requires std::is_invocable_v<Func, T&> || std::is_invocable_v<Func, entity_t, T&>
+              || (sparse_set<T>::is_tag && std::is_invocable_v<Func, entity_t>)
         void direct_for_each(Func func) {
             find_pool<T>()->for_each(func);
         }
 
+        template<typename T, typename Func>
+        requires std::is_invocable_v<Func, const T&> || std::is_invocable_v<Func, entity_t, const T&>
+              || (sparse_set<T>::is_tag && std::is_invocable_v<Func, entity_t>)
+        void direct_for_each(Func func) const {
+            const sparse_set<T>* p = find_pool<T>();
+            if (p != nullptr) {
+                p->for_each(func);
+            }
+        }
+
+        // Double-buffered components, see component_traits
+
+        // Frame boundary: the values written since the last flip become the ones readers see
+        template<typename T>
+        requires sparse_set<T>::double_buffered
+        void flip() {
+            if (sparse_set<T>* p = find_pool<T>()) {
+                p->flip();
+            }
+        }
+
+        // Like flip, but keeps the back values, for writers that only update some of them
+        template<typename T>
+        requires sparse_set<T>::double_buffered
+        void publish() {
+            if (sparse_set<T>* p = find_pool<T>()) {
+                p->publish();
+            }
+        }
+
+        // Reads the values of the last flip, may run while other threads modify the components
+        template<typename T, typename Func>
+        requires sparse_set<T>::double_buffered && (std::is_invocable_v<Func, const T&> || std::is_invocable_v<Func, entity_t, const T&>)
+        void for_each_front(Func func) const {
+            if (const sparse_set<T>* p = find_pool<T>()) {
+                p->for_each_front(func);
+            }
+        }
+
+        // Hierarchy
+
+        void set_parent(entity_t child, entity_t parent) {
+            _hierarchy.attach(*static_cast<sparse_set<relationship>*>(find_or_create_pool<relationship>()), child, parent);
+        }
+
+        void remove_parent(entity_t child) {
+            if (sparse_set<relationship>* rels = find_relationships()) {
+                _hierarchy.detach(*rels, child);
+            }
+        }
+
+        [[nodiscard]] entity_t get_parent(entity_t entity) const {
+            const std::unique_ptr<pool>* p = _pools.get_ptr(type_index<relationship>::value());
+            if (p == nullptr) {
+                return error_entity;
+            }
+            const relationship* r = static_cast<const sparse_set<relationship>*>(p->get())->get_ptr(entity);
+            return r != nullptr ? r->parent : error_entity;
+        }
+
+        // Sorts relationships so that parents precede children and moves the Ts
+        // components of related entities into the same order
+        template<typename... Ts>
+        void sort_hierarchy(hierarchy_order order = hierarchy_order::depth_first) {
+            sparse_set<relationship>* rels = find_relationships();
+            if (rels == nullptr) {
+                return;
+            }
+            _hierarchy.sort(*rels, order);
+            (align_to_hierarchy<Ts>(*rels), ...);
+        }
+
+        // Visits every related entity that has all Ts, parents before children.
+        // func receives the entity, its parent (error_entity for roots) and the components.
+        // Ts pools that are not in hierarchy order are realigned first, so the pass reads them
+        // linearly. Pools owned by a group keep their order and are looked up per entity.
+        template<typename... Ts, typename Func>
+        requires unique_types<Ts...> && std::is_invocable_v<Func, entity_t, entity_t, Ts&...>
+        void for_each_hierarchical(Func func) {
+            FECS_PROFILE_SCOPE("fecs::registry::for_each_hierarchical");
+            sparse_set<relationship>* rels = find_relationships();
+            const std::tuple<sparse_set<Ts>*...> pools { find_pool<Ts>()... };
+            if (rels == nullptr || ((std::get<sparse_set<Ts>*>(pools) == nullptr) || ...)) {
+                return;
+            }
+            _hierarchy.sort(*rels, _hierarchy.order());
+            for_each_hierarchical_impl(*rels, pools, func, std::index_sequence_for<Ts...>{});
+        }
+
+        // Singletons that do not belong to any entity
+        context& ctx() {
+            return _context;
+        }
+
+        const context& ctx() const {
+            return _context;
+        }
+
         // Help methods
 
         void shrink_to_fit() {
@@ -295,6 +622,68 @@ namespace fecs {
             }
         }
 
+        // Gives memory back after mass destruction: unused pool capacity and sparse pages above
+        // the largest id of each pool are freed.
+        // With renumber, entities that have at least one component get the ids [0, n) in their current
+        // order, so no empty page is left, and the returned table maps old ids to new ones
+        // (error_entity for ids without components).
+        // Relationships, indices and groups are updated, ids stored anywhere else have to be translated
+        // by the caller.
+        std::vector<entity_t> compact(bool renumber = false) {
+            FECS_PROFILE_SCOPE("fecs::registry::compact");
+            std::vector<entity_t> remap;
+            if (renumber) {
+                remap = renumber_entities();
+            }
+            shrink_to_fit();
+            return remap;
+        }
+
+        // Snapshot of pool, group and query counters, see util/stats.h for json export
+        [[nodiscard]] registry_stats stats() const {
+            registry_stats result;
+
+            const auto& group_ids = _groups.get_keys();
+            const auto& pool_ids = _pools.get_keys();
+            result.pools.reserve(pool_ids.size());
+            for (size_t i = 0; i < pool_ids.size(); ++i) {
+                const pool* p = _pools.get_ref_directly(i).get();
+
+                pool_stats ps;
+                ps.component = pool_ids[i];
+                ps.size = p->size();
+                ps.capacity = p->capacity();
+                ps.sparse_pages = p->sparse_pages();
+                ps.bytes = p->memory_usage();
+                ps.view_checks = p->recorded_checks();
+                ps.view_rejections = p->recorded_rejections();
+                for (size_t j = 0; j < group_ids.size(); ++j) {
+                    if (p->get_owner() == _groups.get_ref_directly(j).get()) {
+                        ps.owner_group = group_ids[j];
+                        break;
+                    }
+                }
+                result.pools.push_back(ps);
+            }
+
+            result.groups.reserve(group_ids.size());
+            for (size_t i = 0; i < group_ids.size(); ++i) {
+                group_stats gs = _groups.get_ref_directly(i)->stats();
+                gs.group = group_ids[i];
+                result.groups.push_back(gs);
+            }
+
+            const auto& query_ids = _queries.get_keys();
+            result.queries.reserve(query_ids.size());
+            for (size_t i = 0; i < query_ids.size(); ++i) {
+                query_stats qs = _queries.get_ref_directly(i)->stats();
+                qs.query = query_ids[i];
+                result.queries.push_back(qs);
+            }
+
+            return result;
+        }
+
         template<typename Component>
         sparse_set<Component>* find_pool(){
             return static_cast<sparse_set<Component>*>(find_pool(type_index<Component>::value()));
@@ -309,12 +698,115 @@ namespace fecs {
             return nullptr;
         }
 
+        template<typename Component>
+        const sparse_set<Component>* find_pool() const {
+            return static_cast<const sparse_set<Component>*>(find_pool(type_index<Component>::value()));
+        }
+
+        const pool* find_pool(id_index_t associated_component) const {
+            const std::unique_ptr<pool>* p = _pools.get_ptr(associated_component);
+            if (p != nullptr) {
+                return p->get();
+            }
+            FECS_LOG_WARN << "Returning nullptr in pools_registry::find_pool" << FECS_NL;
+            return nullptr;
+        }
+
     private:
         friend class entity_copyer;
 
         unique_ptr_sparse_set<pool> _pools;
         unique_ptr_sparse_set<group_descriptor> _groups;
-        entity_t _entity_counter = 0;
+        unique_ptr_sparse_set<query_descriptor> _queries;
+        // Declared after _pools: indices unregister from their pool when destroyed
+        unique_ptr_sparse_set<index_descriptor> _indices;
+        entity_allocator _entities;
+        context _context;
+        hierarchy _hierarchy;
+
+        std::vector<entity_t> renumber_entities() {
+            std::vector<entity_t> remap(_entities.size(), error_entity);
+            for (const std::unique_ptr<pool>& p : _pools) {
+                for (const entity_t e : p->get_keys()) {
+                    if (e >= remap.size()) {
+                        remap.resize(e + 1, error_entity);
+                    }
+                    remap[e] = 0;
+                }
+            }
+            entity_t next = 0;
+            for (entity_t& e : remap) {
+                if (e != error_entity) {
+                    e = next++;
+                }
+            }
+
+            if (sparse_set<relationship>* rels = find_relationships()) {
+                rels->for_each([&remap](relationship& r) {
+                    for (entity_t* e : { &r.parent, &r.first_child, &r.next_sibling, &r.prev_sibling }) {
+                        if (*e != error_entity) {
+                            *e = remap[*e];
+                        }
+                    }
+                });
+                _hierarchy.mark_dirty();
+            }
+            for (std::unique_ptr<pool>& p : _pools) {
+                p->remap_keys(remap);
+            }
+            _entities.reset(next);
+
+            for (auto& i_uptr : _indices) {
+                i_uptr->rebuild();
+            }
+            for (auto& g_uptr : _groups) {
+                g_uptr->pack_pools();
+            }
+            return remap;
+        }
+
+        sparse_set<relationship>* find_relationships() {
+            std::unique_ptr<pool>* p = _pools.get_ptr(type_index<relationship>::value());
+            return p != nullptr ? static_cast<sparse_set<relationship>*>(p->get()) : nullptr;
+        }
+
+        template<typename... Ts, typename Func, size_t... It>
+        void for_each_hierarchical_impl(sparse_set<relationship>& rels, const std::tuple<sparse_set<Ts>*...>& pools,
+                                        Func& func, std::index_sequence<It...>) {
+            const std::array<bool, sizeof...(Ts)> aligned {
+                (_hierarchy.is_aligned(*std::get<It>(pools)) || _hierarchy.align(rels, *std::get<It>(pools)))...
+            };
+            std::array<size_t, sizeof...(Ts)> next {};
+            const size_t s = rels.size();
+            for (size_t i = 0; i < s; ++i) {
+                const entity_t e = rels.get_key_by_index(i);
+                // Every pool is read, so the positions of aligned pools keep up with the relationships
+                const std::tuple<Ts*...> refs { hierarchical_ref(*std::get<It>(pools), aligned[It], next[It], e)... };
+                if (((std::get<It>(refs) != nullptr) && ...)) {
+                    func(e, rels.get_ref_directly(i).parent, *std::get<It>(refs)...);
+                }
+            }
+        }
+
+        // Aligned pools hold the related entities at their front in relationship order,
+        // so the next one of them is either at next or not in the pool
+        template<typename T>
+        static T* hierarchical_ref(sparse_set<T>& p, bool aligned, size_t& next, entity_t e) {
+            if (!aligned) {
+                return p.get_ptr(e);
+            }
+            if (next < p.size() && p.get_key_by_index(next) == e) {
+                return &p.get_ref_directly(next++);
+            }
+            return nullptr;
+        }
+
+        template<typename T>
+        void align_to_hierarchy(const sparse_set<relationship>& rels) {
+            if (pool* p = find_pool(type_index<T>::value())) {
+                _hierarchy.align(rels, *p);
+            }
+        }
 
         template<typename T>
         pool* find_or_create_pool() {
@@ -327,4 +819,7 @@ namespace fecs {
 
     };
 
+    // Per-thread registry that is filled independently and then passed to registry::merge
+    using staging_registry = registry;
+
 }
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "entity_allocator.h"
+#include "type_index.h"
+#include "type_traits.h"
+#include "types.h"
+#include "../containers/sparse_set.h"
+#include "../queues/group.h"
+#include "../queues/read_only.h"
+#include "../queues/runner.h"
+#include "../queues/view.h"
+#include "../util/log.h"
+#include "../util/profile.h"
+
+namespace fecs {
+
+    // Registry over a component list known at compile time. Pools are members of a tuple,
+    // so finding one is free and destroying an entity touches exactly these pools with
+    // direct calls. Returns the same view, runner and group types as registry.
+    template<typename... Components>
+    requires unique_types<Components...> && (sizeof...(Components) > 0)
+    class static_registry {
+    public:
+        using components = type_list<Components...>;
+
+        template<typename T>
+        static constexpr bool is_component = contains_type<T, Components...>;
+
+        static_registry() = default;
+
+        // Queues and groups point into the pools
+        static_registry(const static_registry&) = delete;
+        static_registry& operator=(const static_registry&) = delete;
+
+        // Entities management
+
+        entity_t create_entity() {
+            return _entities.create();
+        }
+
+        void destroy_entity(entity_t entity) {
+            FECS_PROFILE_SCOPE("fecs::static_registry::destroy_entity");
+            (std::get<sparse_set<Components>>(_pools).remove(entity), ...);
+            _entities.release(entity);
+        }
+
+        // Thread-safe, returns the first of count consecutive fresh ids
+        entity_t reserve_entities(entity_t count) {
+            return _entities.reserve(count);
+        }
+
+        entity_allocator& entities() {
+            return _entities;
+        }
+
+        void set_entity_recycling(bool recycling) {
+            _entities.set_recycling(recycling);
+        }
+
+        // Components management
+
+        template<typename Component, typename... Args>
+        requires is_component<Component> && std::is_constructible_v<Component, Args&&...>
+        void add_component(entity_t entity, Args&&... args) {
+            find_pool<Component>()->emplace(entity, std::forward<Args>(args)...);
+        }
+
+        template<typename Component, typename... Args>
+        requires is_component<Component> && std::is_constructible_v<Component, Args&&...>
+        void add_component(const std::vector<entity_t>& entities, Args&&... args) {
+            sparse_set<Component>* p = find_pool<Component>();
+            for (entity_t entity : entities) {
+                p->emplace(entity, args...);
+            }
+        }
+
+        template<typename Component>
+        requires is_component<Component>
+        void remove_component(entity_t entity) {
+            find_pool<Component>()->remove(entity);
+        }
+
+        template<typename Component>
+        requires is_component<Component>
+        void remove_component(const std::vector<entity_t>& entities) {
+            sparse_set<Component>* p = find_pool<Component>();
+            for (entity_t entity : entities) {
+                p->remove(entity);
+            }
+        }
+
+        template<typename... Ts>
+        requires (is_component<Ts> && ...)
+        void remove_components(entity_t entity) {
+            (remove_component<Ts>(entity), ...);
+        }
+
+        template<typename Component, typename Func>
+        requires is_component<Component> && std::is_invocable_v<Func, Component&>
+        void patch(entity_t entity, Func func) {
+            find_pool<Component>()->patch(entity, func);
+        }
+
+        template<typename Component, typename... Args>
+        requires is_component<Component> && std::is_constructible_v<Component, Args&&...>
+        void replace(entity_t entity, Args&&... args) {
+            find_pool<Component>()->replace(entity, std::forward<Args>(args)...);
+        }
+
+        template<typename Component>
+        requires is_component<Component>
+        void set_membership_tracking(bool enabled = true) {
+            find_pool<Component>()->set_membership_tracking(enabled);
+        }
+
+        template<typename Component>
+        requires is_component<Component>
+        bool has_component(entity_t entity) const {
+            return find_pool<Component>()->contains(entity);
+        }
+
+        // Packs all components of types for very fast access
+        template<typename... Ts>
+        requires unique_types<Ts...> && (sizeof...(Ts) > 1) && (is_component<Ts> && ...)
+        void create_group() {
+            using group_t = fecs::group<pack_part<Ts...>, view_part<>>;
+            const id_index_t id_index = type_index<group_t>::value();
+            if (_groups.contains(id_index)) {
+                return;
+            }
+            assert_not_owned<Ts...>();
+
+            typename group_t::p_pools_array pools = { find_pool<Ts>()... };
+            const size_t index = _groups.emplace(id_index, std::make_unique<group_t>(pools));
+            _groups.get_ref_directly(index)->pack_pools();
+        }
+
+        template<typename... PTs, typename... VTs>
+        requires unique_types<PTs..., VTs...> && (sizeof...(PTs) > 1) && (is_component<PTs> && ...) && (is_component<VTs> && ...)
+        void create_group(view_part<VTs...>) {
+            using group_t = fecs::group<pack_part<PTs...>, view_part<VTs...>>;
+            const id_index_t id_index = type_index<group_t>::value();
+            if (_groups.contains(id_index)) {
+                return;
+            }
+            assert_not_owned<PTs...>();
+
+            typename group_t::p_pools_array ppools = { find_pool<PTs>()... };
+            typename group_t::v_pools_array vpools = { find_pool<VTs>()... };
+            const size_t index = _groups.emplace(id_index, std::make_unique<group_t>(ppools, vpools));
+            _groups.get_ref_directly(index)->pack_pools();
+        }
+
+        // Different 'iterators'
+
+        template<typename... Ts>
+        requires unique_types<Ts...> && (sizeof...(Ts) > 1)
+        fecs::group<pack_part<Ts...>, view_part<>>* group() {
+            using group_t = fecs::group<pack_part<Ts...>, view_part<>>;
+            auto group_u_ptr = _groups.get_ptr(type_index<group_t>::value());
+            if (group_u_ptr != nullptr) {
+                return static_cast<group_t*>(group_u_ptr->get());
+            }
+            FECS_ASSERT_M(false, "Before using static_registry::group you have to static_registry::create_group");
+            return nullptr;
+        }
+
+        template<typename... PTs, typename... VTs>
+        requires unique_types<PTs..., VTs...> && (sizeof...(PTs) > 1)
+        fecs::group<pack_part<PTs...>, view_part<VTs...>>* group(view_part<VTs...>) {
+            using group_t = fecs::group<pack_part<PTs...>, view_part<VTs...>>;
+            auto group_u_ptr = _groups.get_ptr(type_index<group_t>::value());
+            if (group_u_ptr != nullptr) {
+                return static_cast<group_t*>(group_u_ptr->get());
+            }
+            FECS_ASSERT_M(false, "Before using static_registry::group you have to static_registry::create_group");
+            return nullptr;
+        }
+
+        template<typename... Ts>
+        requires unique_types<Ts...> && (sizeof...(Ts) > 1) && (is_component<Ts> && ...)
+        fecs::view<Ts...> view() {
+            return fecs::view<Ts...>(typename fecs::view<Ts...>::pools_array{ find_pool<Ts>()... });
+        }
+
+        template<typename... Ts>
+        requires unique_types<Ts...> && (sizeof...(Ts) > 1) && (is_component<Ts> && ...)
+        read_only<fecs::view<Ts...>> view() const {
+            return read_only(const_cast<static_registry*>(this)->view<Ts...>());
+        }
+
+        template<typename T>
+        requires is_component<T>
+        fecs::runner<T> runner() {
+            return fecs::runner<T>(find_pool<T>());
+        }
+
+        template<typename T>
+        requires is_component<T>
+        read_only<fecs::runner<T>> runner() const {
+            return read_only(const_cast<static_registry*>(this)->runner<T>());
+        }
+
+        template<typename T, typename Func>
+        requires is_component<T> && (std::is_invocable_v<Func, T&> || std::is_invocable_v<Func, entity_t, T&>
+              || (sparse_set<T>::is_tag && std::is_invocable_v<Func, entity_t>))
+        void direct_for_each(Func func) {
+            find_pool<T>()->for_each(func);
+        }
+
+        template<typename T, typename Func>
+        requires is_component<T> && (std::is_invocable_v<Func, const T&> || std::is_invocable_v<Func, entity_t, const T&>
+              || (sparse_set<T>::is_tag && std::is_invocable_v<Func, entity_t>))
+        void direct_for_each(Func func) const {
+            find_pool<T>()->for_each(func);
+        }
+
+        // Double-buffered components, see component_traits
+
+        template<typename T>
+        requires is_component<T> && sparse_set<T>::double_buffered
+        void flip() {
+            find_pool<T>()->flip();
+        }
+
+        template<typename T>
+        requires is_component<T> && sparse_set<T>::double_buffered
+        void publish() {
+            find_pool<T>()->publish();
+        }
+
+        template<typename T, typename Func>
+        requires is_component<T> && sparse_set<T>::double_buffered
+              && (std::is_invocable_v<Func, const T&> || std::is_invocable_v<Func, entity_t, const T&>)
+        void for_each_front(Func func) const {
+            find_pool<T>()->for_each_front(func);
+        }
+
+        // Help methods
+
+        void shrink_to_fit() {
+            (std::get<sparse_set<Components>>(_pools).shrink_to_fit(), ...);
+        }
+
+        // Never null, every pool exists for the whole lifetime of the registry
+        template<typename Component>
+        requires is_component<Component>
+        sparse_set<Component>* find_pool() {
+            return &std::get<sparse_set<Component>>(_pools);
+        }
+
+        template<typename Component>
+        requires is_component<Component>
+        const sparse_set<Component>* find_pool() const {
+            return &std::get<sparse_set<Component>>(_pools);
+        }
+
+    private:
+        std::tuple<sparse_set<Components>...> _pools;
+        unique_ptr_sparse_set<group_descriptor> _groups;
+        entity_allocator _entities;
+
+        template<typename... Ts>
+        void assert_not_owned() {
+            for (auto& g_uptr : _groups) {
+                if (((g_uptr->template own<Ts>()) || ...)) {
+                    FECS_ASSERT_M(false, "Groups conflict: only one group can own component");
+                }
+            }
+        }
+
+    };
+
+}
@@ -19,6 +19,19 @@ namespace fecs {
     template<typename T, typename... Ts>
     constexpr bool contains_type = (std::is_same_v<T, Ts> || ...);
 
+    // Adds const when a queue is iterated through its read-only path
+    template<bool read_only, typename T>
+    using maybe_const_t = std::conditional_t<read_only, const T, T>;
+
+    template<typename>
+    struct member_pointer_traits;
+
+    template<typename C, typename F>
+    struct member_pointer_traits<F C::*> {
+        using class_t = C;
+        using field_t = F;
+    };
+
     template<typename... Ts>
     struct type_list {
         using types = std::tuple<Ts...>;
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <numeric>
+#include <ostream>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "../core/registry.h"
+#include "../util/log.h"
+#include "../util/profile.h"
+
+namespace fecs {
+
+    // Creates entities from fixed-layout column chunks: every row of a chunk becomes a new
+    // entity with all Components. Each pool is filled once per chunk and groups see every
+    // entity once, after all of its components are in place. Memory use is bounded by
+    // chunk_size rows, whatever the size of the input.
+    //
+    // Binary chunk format: uint64_t row count, then the column of every non-empty component
+    // in template order (count * sizeof(Component) bytes each). Tags take no bytes.
+    template<typename... Components>
+    requires unique_types<Components...> && (sizeof...(Components) > 0)
+          && (std::is_trivially_copyable_v<Components> && ...)
+          && (!std::is_same_v<Components, relationship> && ...)
+    class bulk_importer {
+    public:
+        static constexpr size_t default_chunk_size = 65536;
+
+        explicit bulk_importer(registry& registry, size_t chunk_size = default_chunk_size)
+            : _registry(registry), _chunk_size(std::max<size_t>(chunk_size, 1)) {
+            (_registry.create_pool<Components>(), ...);
+            (std::get<std::vector<Components>>(_columns).resize(_chunk_size), ...);
+            _keys.reserve(_chunk_size);
+        }
+
+        // Imports count rows whose columns are already in memory, tag columns may be null.
+        // Rows get consecutive ids, the first one is returned.
+        entity_t import_columns(size_t count, const Components*... columns) {
+            const entity_t first = _registry.reserve_entities(static_cast<entity_t>(count));
+            for (size_t done = 0; done < count; done += _chunk_size) {
+                const size_t rows = std::min(_chunk_size, count - done);
+                insert_chunk(first + static_cast<entity_t>(done), rows, advance(columns, done)...);
+            }
+            return first;
+        }
+
+        // source(max_rows, Components*... columns) writes up to max_rows rows into the column
+        // buffers and returns how many it wrote, 0 ends the import. Suits text formats
+        // such as CSV that are parsed row by row. Returns the number of imported entities.
+        template<typename Source>
+        requires std::is_invocable_r_v<size_t, Source, size_t, Components*...>
+        size_t import(Source source) {
+            size_t total = 0;
+            while (true) {
+                const size_t rows = std::min(_chunk_size, static_cast<size_t>(
+                    source(_chunk_size, std::get<std::vector<Components>>(_columns).data()...)));
+                if (rows == 0) {
+                    return total;
+                }
+                const entity_t first = _registry.reserve_entities(static_cast<entity_t>(rows));
+                insert_chunk(first, rows, std::get<std::vector<Components>>(_columns).data()...);
+                total += rows;
+            }
+        }
+
+        // Reads binary chunks until the stream ends. A chunk must not exceed chunk_size rows,
+        // a truncated or oversized chunk stops the import and is dropped.
+        size_t import(std::istream& in) {
+            return import([this, &in](size_t max_rows, Components*... columns) -> size_t {
+                uint64_t rows = 0;
+                if (!in.read(reinterpret_cast<char*>(&rows), sizeof(rows))) {
+                    return 0;
+                }
+                if (rows > max_rows) {
+                    FECS_LOG_WARN << "bulk_importer: chunk of " << rows << " rows exceeds chunk_size" << FECS_NL;
+                    return 0;
+                }
+                if (!(read_column(in, columns, static_cast<size_t>(rows)) && ...)) {
+                    FECS_LOG_WARN << "bulk_importer: truncated chunk" << FECS_NL;
+                    return 0;
+                }
+                return static_cast<size_t>(rows);
+            });
+        }
+
+        // Writes one chunk in the format import(std::istream&) reads, tag columns may be null
+        static void write_chunk(std::ostream& out, size_t count, const Components*... columns) {
+            const uint64_t rows = count;
+            out.write(reinterpret_cast<const char*>(&rows), sizeof(rows));
+            (write_column(out, columns, count), ...);
+        }
+
+    private:
+        registry& _registry;
+        size_t _chunk_size;
+        std::tuple<std::vector<Components>...> _columns;
+        std::vector<entity_t> _keys;
+
+        template<typename T>
+        static const T* advance(const T* column, size_t rows) {
+            return column != nullptr ? column + rows : nullptr;
+        }
+
+        template<typename T>
+        static bool read_column(std::istream& in, T* column, size_t rows) {
+            if constexpr (std::is_empty_v<T>) {
+                return true;
+            }
+            else {
+                return static_cast<bool>(in.read(reinterpret_cast<char*>(column), static_cast<std::streamsize>(rows * sizeof(T))));
+            }
+        }
+
+        template<typename T>
+        static void write_column(std::ostream& out, const T* column, size_t rows) {
+            if constexpr (!std::is_empty_v<T>) {
+                out.write(reinterpret_cast<const char*>(column), static_cast<std::streamsize>(rows * sizeof(T)));
+            }
+        }
+
+        void insert_chunk(entity_t first, size_t rows, const Components*... columns) {
+            FECS_PROFILE_SCOPE("fecs::bulk_importer::insert_chunk");
+            _keys.resize(rows);
+            std::iota(_keys.begin(), _keys.end(), first);
+
+            std::array<pool::owner*, sizeof...(Components)> owners { insert_column(columns, rows)... };
+
+            // A group owns several of these pools, it is triggered once per entity
+            for (size_t i = 0; i < owners.size(); ++i) {
+                if (owners[i] == nullptr || std::find(owners.begin(), owners.begin() + i, owners[i]) != owners.begin() + i) {
+                    continue;
+                }
+                for (const entity_t e : _keys) {
+                    owners[i]->trigger_emplace(e);
+                }
+            }
+        }
+
+        template<typename T>
+        pool::owner* insert_column(const T* column, size_t rows) {
+            sparse_set<T>* p = _registry.find_pool<T>();
+            p->insert_bulk(_keys.data(), column, rows);
+            return p->get_owner();
+        }
+
+    };
+
+}
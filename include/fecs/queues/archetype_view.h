@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "../containers/archetype.h"
+#include "../core/type_index.h"
+#include "../core/type_traits.h"
+#include "../core/types.h"
+#include "../util/profile.h"
+
+namespace fecs {
+
+    // Tables that have every component of a view. Tables are never destroyed,
+    // so only the ones created since the last refresh have to be checked.
+    class archetype_matches {
+    public:
+        explicit archetype_matches(std::vector<id_index_t> ids)
+            : _ids(std::move(ids)) {}
+
+        void refresh(const std::vector<std::unique_ptr<archetype>>& all) {
+            for (; _checked < all.size(); ++_checked) {
+                if (all[_checked]->has_all(_ids)) {
+                    _archetypes.push_back(all[_checked].get());
+                }
+            }
+        }
+
+        [[nodiscard]] const std::vector<archetype*>& archetypes() const {
+            return _archetypes;
+        }
+
+    private:
+        std::vector<id_index_t> _ids;
+        std::vector<archetype*> _archetypes;
+        size_t _checked = 0;
+
+    };
+
+    // Walks matching tables one after another, every column is read contiguously
+    template<typename... Ts>
+    requires unique_types<Ts...> && (sizeof...(Ts) > 0)
+    class archetype_view {
+    public:
+        archetype_view(archetype_matches* matches, const std::vector<std::unique_ptr<archetype>>* all)
+            : _matches(matches), _all(all) {}
+
+        template<typename Func>
+        requires std::is_invocable_v<Func, Ts&...> || std::is_invocable_v<Func, entity_t, Ts&...>
+        void for_each(Func func) {
+            _matches->refresh(*_all);
+            for_each_impl<false>(func);
+        }
+
+        // The match cache only grows, so refreshing it does not change what the view refers to
+        template<typename Func>
+        requires std::is_invocable_v<Func, const Ts&...> || std::is_invocable_v<Func, entity_t, const Ts&...>
+        void for_each(Func func) const {
+            _matches->refresh(*_all);
+            for_each_impl<true>(func);
+        }
+
+    private:
+        archetype_matches* _matches;
+        const std::vector<std::unique_ptr<archetype>>* _all;
+
+        template<bool read_only, typename Func>
+        void for_each_impl(Func func) const {
+            FECS_PROFILE_SCOPE("fecs::archetype_view::for_each");
+            for (archetype* a : _matches->archetypes()) {
+                const size_t s = a->size();
+                if (s == 0) {
+                    continue;
+                }
+                const std::tuple<maybe_const_t<read_only, Ts>*...> columns(a->template get_column<Ts>().data()...);
+                if constexpr (std::is_invocable_v<Func, maybe_const_t<read_only, Ts>&...>) {
+                    for (size_t i = 0; i < s; ++i) {
+                        func(std::get<maybe_const_t<read_only, Ts>*>(columns)[i]...);
+                    }
+                }
+                else {
+                    const entity_t* entities = a->entities().data();
+                    for (size_t i = 0; i < s; ++i) {
+                        func(entities[i], std::get<maybe_const_t<read_only, Ts>*>(columns)[i]...);
+                    }
+                }
+            }
+        }
+
+    };
+
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "../containers/dense_bitset.h"
+#include "../containers/pool.h"
+#include "../core/types.h"
+
+namespace fecs {
+
+    // How much work a resumable for_each may do in one call, entities or time or both
+    class cursor_budget {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        cursor_budget(size_t entities)
+            : _entities(entities) {}
+
+        template<typename Rep, typename Period>
+        cursor_budget(std::chrono::duration<Rep, Period> time)
+            : _time(std::chrono::duration_cast<clock::duration>(time)), _timed(true) {}
+
+        cursor_budget(size_t entities, clock::duration time)
+            : _entities(entities), _time(time), _timed(true) {}
+
+    private:
+        friend class cursor;
+
+        size_t _entities = std::numeric_limits<size_t>::max();
+        clock::duration _time = clock::duration::max();
+        bool _timed = false;
+
+    };
+
+    // Position of a time-sliced iteration, kept by the system between frames.
+    // The range is walked from the back and entities seen in the current pass are remembered.
+    // A removal only moves the last element into the freed slot, so the cursor keeps its place.
+    // When the range is reordered otherwise (sorting, group repacking) it checks the whole range
+    // again and skips visited entities. Skipped ones count as work against the budget,
+    // but every call visits at least one entity so a pass always finishes.
+    // Entities that are created during a pass may be left for the next one.
+    class cursor {
+    public:
+        // Starts a new pass on the next call
+        void reset() {
+            _visited.clear();
+            _index = 0;
+            _count = 0;
+            _pool = nullptr;
+        }
+
+        // Entities visited so far in the current pass
+        [[nodiscard]] size_t visited() const {
+            return _count;
+        }
+
+        // Calls visit(index) for not yet visited entities of driving in [0, end()),
+        // returns true and resets when the pass is complete.
+        // order() changes whenever the range is reordered by anything but removals.
+        template<typename Order, typename End, typename Visit>
+        bool advance(const pool& driving, Order order, End end, cursor_budget budget, Visit visit) {
+            sync(driving, order(), end());
+            const auto start = budget._timed ? cursor_budget::clock::now() : cursor_budget::clock::time_point{};
+            size_t work = 0;
+            size_t processed = 0;
+            while (_index > 0) {
+                if (processed != 0 && work >= budget._entities) {
+                    return false;
+                }
+                // Reading the clock per entity would cost more than most systems do per entity
+                if (budget._timed && processed != 0 && work % time_check_interval == 0
+                    && cursor_budget::clock::now() - start >= budget._time) {
+                    return false;
+                }
+
+                ++work;
+                const size_t index = --_index;
+                const entity_t e = driving.get_key_by_index(index);
+                if (_visited.test(e)) {
+                    continue;
+                }
+                _visited.set(e);
+                ++_count;
+                ++processed;
+                visit(index);
+
+                // visit itself may have removed or added components
+                sync(driving, order(), end());
+            }
+            reset();
+            return true;
+        }
+
+        // Over the whole driving pool
+        template<typename End, typename Visit>
+        bool advance(const pool& driving, End end, cursor_budget budget, Visit visit) {
+            return advance(driving, [&driving] { return driving.order_version(); }, end, budget, visit);
+        }
+
+    private:
+        static constexpr size_t time_check_interval = 64;
+
+        dense_bitset _visited;
+        const pool* _pool = nullptr;
+        uint64_t _order = 0;
+        // Entities in [0, _index) may not be visited yet, the ones behind it are
+        size_t _index = 0;
+        size_t _count = 0;
+
+        void sync(const pool& driving, uint64_t order, size_t end) {
+            if (_pool != &driving || _order != order) {
+                _pool = &driving;
+                _order = order;
+                _index = end;
+            }
+            else {
+                _index = std::min(_index, end);
+            }
+        }
+
+    };
+
+}
@@ -2,13 +2,19 @@
 
 #include <algorithm>
 #include <array>
+#include <tuple>
 #include <type_traits>
 #include <utility>
 
+#include "cursor.h"
 #include "group_base.h"
+#include "iterators.h"
+#include "view.h"
 #include "../core/types.h"
 #include "../core/type_traits.h"
 #include "../containers/sparse_set.h"
+#include "../util/log.h"
+#include "../util/profile.h"
 
 namespace fecs {
 
@@ -31,27 +37,151 @@ namespace fecs {
         template<typename Func>
         requires std::is_invocable_v<Func, PTs&..., VTs&...> || std::is_invocable_v<Func, entity_t, PTs&..., VTs&...>
         void for_each(Func func) {
-            for_each_impl(func, p_components::sequence, v_components::sequence);
+            this->refresh();
+            for_each_impl<false>(func, p_components::sequence, v_components::sequence);
+        }
+
+        template<typename Func>
+        requires std::is_invocable_v<Func, const PTs&..., const VTs&...> || std::is_invocable_v<Func, entity_t, const PTs&..., const VTs&...>
+        void for_each(Func func) const {
+            if (this->is_dirty()) {
+                const auto unpacked = unpacked_view();
+                unpacked.for_each(func);
+                return;
+            }
+            for_each_impl<true>(func, p_components::sequence, v_components::sequence);
+        }
+
+        // Visits at most budget packed entities per call and continues where the previous call
+        // stopped, returns true once the pass is complete. Repacking restarts the scan, visited entities are skipped.
+        template<typename Func>
+        requires std::is_invocable_v<Func, PTs&..., VTs&...> || std::is_invocable_v<Func, entity_t, PTs&..., VTs&...>
+        bool for_each(cursor& c, cursor_budget budget, Func func) {
+            this->refresh();
+            return for_each_cursor_impl<false>(c, budget, func, p_components::sequence, v_components::sequence);
+        }
+
+        template<typename Func>
+        requires std::is_invocable_v<Func, const PTs&..., const VTs&...> || std::is_invocable_v<Func, entity_t, const PTs&..., const VTs&...>
+        bool for_each(cursor& c, cursor_budget budget, Func func) const {
+            if (this->is_dirty()) {
+                const auto unpacked = unpacked_view();
+                return unpacked.for_each(c, budget, func);
+            }
+            return for_each_cursor_impl<true>(c, budget, func, p_components::sequence, v_components::sequence);
+        }
+
+        // Yields std::tuple<entity_t, PTs&..., VTs&...> for packed entities that have every view component
+        using iterator = filter_iterator<group, false>;
+        using const_iterator = filter_iterator<group, true>;
+
+        [[nodiscard]] iterator begin() {
+            this->refresh();
+            return iterator(this, 0, _next_index);
+        }
+
+        [[nodiscard]] iterator end() {
+            this->refresh();
+            return iterator(this, _next_index, _next_index);
+        }
+
+        [[nodiscard]] const_iterator begin() const {
+            this->require_packed();
+            return const_iterator(this, 0, _next_index);
+        }
+
+        [[nodiscard]] const_iterator end() const {
+            this->require_packed();
+            return const_iterator(this, _next_index, _next_index);
         }
 
     private:
+        template<typename, bool>
+        friend class filter_iterator;
+
         using group_base_t::_pools;
         using group_base_t::_next_index;
 
         v_pools_array _v_pools;
 
-        template<size_t index>
+        // Read-only passes over a dirty group can't repack it and look the components up instead
+        [[nodiscard]] fecs::view<PTs..., VTs...> unpacked_view() const {
+            std::array<pool*, p_components::size + v_components::size> pools;
+            std::copy(_pools.begin(), _pools.end(), pools.begin());
+            std::copy(_v_pools.begin(), _v_pools.end(), pools.begin() + p_components::size);
+            return fecs::view<PTs..., VTs...>(pools);
+        }
+
+        [[nodiscard]] bool accepts(size_t index) const {
+            const entity_t e = _pools[0]->get_key_by_index(index);
+            const size_t page = e / SPARSE_MAX_SIZE;
+            const size_t offset = e % SPARSE_MAX_SIZE;
+            for (size_t j = 0; j < v_components::size; ++j) {
+                if (!_v_pools[j]->contains(page, offset)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        template<bool read_only>
+        auto fetch(size_t index) const {
+            return fetch_impl<read_only>(index, p_components::sequence, v_components::sequence);
+        }
+
+        template<bool read_only, size_t... PIs, size_t... VIs>
+        auto fetch_impl(size_t index, std::index_sequence<PIs...>, std::index_sequence<VIs...>) const {
+            const entity_t e = _pools[0]->get_key_by_index(index);
+            const size_t page = e / SPARSE_MAX_SIZE;
+            const size_t offset = e % SPARSE_MAX_SIZE;
+            return std::tuple<entity_t, maybe_const_t<read_only, PTs>&..., maybe_const_t<read_only, VTs>&...>(e,
+                group_base_t::template get_pool<PIs, read_only>()->get_ref_directly(index)...,
+                get_view_pool<VIs, read_only>()->get_ref_directly_e(page, offset)...);
+        }
+
+        template<size_t index, bool read_only = false>
         auto get_view_pool() const {
             using component_t = typename v_components::template get<index>;
-            return static_cast<sparse_set<component_t>*>(_v_pools[index]);
+            return static_cast<maybe_const_t<read_only, sparse_set<component_t>>*>(_v_pools[index]);
+        }
+
+        template<bool read_only, typename Func, size_t... PIs, size_t... VIs>
+        bool for_each_cursor_impl(cursor& c, cursor_budget budget, Func func, std::index_sequence<PIs...>, std::index_sequence<VIs...>) const {
+            FECS_PROFILE_SCOPE("fecs::group::for_each");
+            const pool* first_pool = _pools[0];
+            size_t visited = 0;
+            const bool done = c.advance(*first_pool, [this] { return group_base_t::order_version(); }, [this] { return _next_index; }, budget, [&](size_t i) {
+                ++visited;
+                if (!accepts(i)) {
+                    return;
+                }
+                const entity_t e = first_pool->get_key_by_index(i);
+                const size_t page = e / SPARSE_MAX_SIZE;
+                const size_t offset = e % SPARSE_MAX_SIZE;
+                if constexpr (std::is_invocable_v<Func, maybe_const_t<read_only, PTs>&..., maybe_const_t<read_only, VTs>&...>) {
+                    func(group_base_t::template get_pool<PIs, read_only>()->get_ref_directly(i)...,
+                                                get_view_pool<VIs, read_only>()->get_ref_directly_e(page, offset)...);
+                }
+                else {
+                    func(e,
+                        group_base_t::template get_pool<PIs, read_only>()->get_ref_directly(i)...,
+                                                get_view_pool<VIs, read_only>()->get_ref_directly_e(page, offset)...);
+                }
+            });
+            group_base_t::count_iteration(visited);
+            return done;
         }
 
-        template<typename Func, size_t... PIs, size_t... VIs>
-        void for_each_impl(Func func, std::index_sequence<PIs...>, std::index_sequence<VIs...>) {
+        template<bool read_only, typename Func, size_t... PIs, size_t... VIs>
+        void for_each_impl(Func func, std::index_sequence<PIs...>, std::index_sequence<VIs...>) const {
+            FECS_PROFILE_SCOPE("fecs::group::for_each");
+            group_base_t::count_iteration(_next_index);
             const pool* first_pool = _pools[0];
+            const auto& keys = first_pool->get_keys();
 
-            if constexpr (std::is_invocable_v<Func, PTs&..., VTs&...>) {
+            if constexpr (std::is_invocable_v<Func, maybe_const_t<read_only, PTs>&..., maybe_const_t<read_only, VTs>&...>) {
                 for (size_t i = 0; i < _next_index; ++i) {
+                    prefetch_lookups(keys, i, _next_index, get_view_pool<VIs, true>()...);
                     const entity_t e = first_pool->get_key_by_index(i);
                     const size_t page = e / SPARSE_MAX_SIZE;
                     const size_t offset = e % SPARSE_MAX_SIZE;
@@ -64,13 +194,14 @@ namespace fecs {
                         }
                     }
                     if (passed) {
-                        func(group_base_t::template get_pool<PIs>()->get_ref_directly(i)...,
-                                                    get_view_pool<VIs>()->get_ref_directly_e(page, offset)...);
+                        func(group_base_t::template get_pool<PIs, read_only>()->get_ref_directly(i)...,
+                                                    get_view_pool<VIs, read_only>()->get_ref_directly_e(page, offset)...);
                     }
                 }
             }
             else {
                 for (size_t i = 0; i < _next_index; ++i) {
+                    prefetch_lookups(keys, i, _next_index, get_view_pool<VIs, true>()...);
                     const entity_t e = first_pool->get_key_by_index(i);
                     const size_t page = e / SPARSE_MAX_SIZE;
                     const size_t offset = e % SPARSE_MAX_SIZE;
@@ -84,8 +215,8 @@ namespace fecs {
                     }
                     if (passed) {
                         func(e,
-                            group_base_t::template get_pool<PIs>()->get_ref_directly(i)...,
-                                                    get_view_pool<VIs>()->get_ref_directly_e(page, offset)...);
+                            group_base_t::template get_pool<PIs, read_only>()->get_ref_directly(i)...,
+                                                    get_view_pool<VIs, read_only>()->get_ref_directly_e(page, offset)...);
                     }
                 }
             }
@@ -106,24 +237,110 @@ namespace fecs {
         template<typename Func>
         requires std::is_invocable_v<Func, Ts&...> || std::is_invocable_v<Func, entity_t, Ts&...>
         void for_each(Func func) {
-            for_each_impl(func, p_components::sequence);
+            this->refresh();
+            for_each_impl<false>(func, p_components::sequence);
+        }
+
+        template<typename Func>
+        requires std::is_invocable_v<Func, const Ts&...> || std::is_invocable_v<Func, entity_t, const Ts&...>
+        void for_each(Func func) const {
+            if (this->is_dirty()) {
+                const auto unpacked = unpacked_view();
+                unpacked.for_each(func);
+                return;
+            }
+            for_each_impl<true>(func, p_components::sequence);
+        }
+
+        // Visits at most budget entities per call and continues where the previous call stopped,
+        // returns true once the pass is complete. Repacking restarts the scan, visited entities are skipped.
+        template<typename Func>
+        requires std::is_invocable_v<Func, Ts&...> || std::is_invocable_v<Func, entity_t, Ts&...>
+        bool for_each(cursor& c, cursor_budget budget, Func func) {
+            this->refresh();
+            return for_each_cursor_impl<false>(c, budget, func, p_components::sequence);
+        }
+
+        template<typename Func>
+        requires std::is_invocable_v<Func, const Ts&...> || std::is_invocable_v<Func, entity_t, const Ts&...>
+        bool for_each(cursor& c, cursor_budget budget, Func func) const {
+            if (this->is_dirty()) {
+                const auto unpacked = unpacked_view();
+                return unpacked.for_each(c, budget, func);
+            }
+            return for_each_cursor_impl<true>(c, budget, func, p_components::sequence);
+        }
+
+        // Yields std::tuple<entity_t, Ts&...>, the packed range is contiguous so the iterators are random access
+        using iterator = packed_iterator<Ts...>;
+        using const_iterator = packed_iterator<const Ts...>;
+
+        [[nodiscard]] iterator begin() {
+            this->refresh();
+            return make_iterator<false>(0, p_components::sequence);
+        }
+
+        [[nodiscard]] iterator end() {
+            this->refresh();
+            return make_iterator<false>(_next_index, p_components::sequence);
+        }
+
+        [[nodiscard]] const_iterator begin() const {
+            this->require_packed();
+            return make_iterator<true>(0, p_components::sequence);
+        }
+
+        [[nodiscard]] const_iterator end() const {
+            this->require_packed();
+            return make_iterator<true>(_next_index, p_components::sequence);
         }
 
     private:
         using group_base_t::_pools;
         using group_base_t::_next_index;
 
-        template<typename Func, size_t... Is>
-        void for_each_impl(Func func, std::index_sequence<Is...>) {
-            if constexpr (std::is_invocable_v<Func, Ts&...>) {
+        // Read-only passes over a dirty group can't repack it and look the components up instead
+        [[nodiscard]] fecs::view<Ts...> unpacked_view() const {
+            return fecs::view<Ts...>(_pools);
+        }
+
+        template<bool read_only, size_t... Is>
+        auto make_iterator(size_t index, std::index_sequence<Is...>) const {
+            using iterator_t = std::conditional_t<read_only, const_iterator, iterator>;
+            return iterator_t(_pools[0], typename iterator_t::pools_tuple(group_base_t::template get_pool<Is, read_only>()...), index);
+        }
+
+        template<bool read_only, typename Func, size_t... Is>
+        bool for_each_cursor_impl(cursor& c, cursor_budget budget, Func func, std::index_sequence<Is...>) const {
+            FECS_PROFILE_SCOPE("fecs::group::for_each");
+            const pool* first_pool = _pools[0];
+            size_t visited = 0;
+            const bool done = c.advance(*first_pool, [this] { return group_base_t::order_version(); }, [this] { return _next_index; }, budget, [&](size_t i) {
+                ++visited;
+                if constexpr (std::is_invocable_v<Func, maybe_const_t<read_only, Ts>&...>) {
+                    func(group_base_t::template get_pool<Is, read_only>()->get_ref_directly(i)...);
+                }
+                else {
+                    func(first_pool->get_key_by_index(i), group_base_t::template get_pool<Is, read_only>()->get_ref_directly(i)...);
+                }
+            });
+            group_base_t::count_iteration(visited);
+            return done;
+        }
+
+        template<bool read_only, typename Func, size_t... Is>
+        void for_each_impl(Func func, std::index_sequence<Is...>) const {
+            FECS_PROFILE_SCOPE("fecs::group::for_each");
+            group_base_t::count_iteration(_next_index);
+            if constexpr (std::is_invocable_v<Func, maybe_const_t<read_only, Ts>&...>) {
                 for (size_t i = 0; i < _next_index; ++i) {
-                    func(group_base_t::template get_pool<Is>()->get_ref_directly(i)...);
+                    func(group_base_t::template get_pool<Is, read_only>()->get_ref_directly(i)...);
                 }
             }
             else {
                 const pool* first_pool = _pools[0];
                 for (size_t i = 0; i < _next_index; ++i) {
-                    func(first_pool->get_key_by_index(i), group_base_t::template get_pool<Is>()->get_ref_directly_e(i)...);
+                    func(first_pool->get_key_by_index(i), group_base_t::template get_pool<Is, read_only>()->get_ref_directly(i)...);
                 }
             }
         }
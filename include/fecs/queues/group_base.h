@@ -5,8 +5,18 @@
 #ifndef GROUP_BASE_H
 #define GROUP_BASE_H
 
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
 #include "../containers/pool.h"
+#include "../containers/sparse_set.h"
 #include "../core/type_index.h"
+#include "../util/aligned_allocator.h"
+#include "../util/parallel.h"
+#include "../util/profile.h"
+#include "../util/stats.h"
 #include "ranges"
 
 namespace fecs {
@@ -21,11 +31,48 @@ namespace fecs {
         ~group_descriptor() override = default;
         [[nodiscard]] virtual bool own(id_index_t id_index) const = 0;
         virtual void pack_pools() = 0;
+        // Whether entity has every owned component, packed or not
+        [[nodiscard]] virtual bool contains(entity_t entity) const = 0;
 
         [[nodiscard]] const size_t * get_next_index_ptr() const {
             return &_next_index;
         }
 
+        // Number of packed entities
+        [[nodiscard]] size_t size() const {
+            return _next_index;
+        }
+
+        // A lazy group only marks itself dirty on emplace/remove of owned components
+        // and is repacked in one pass by the next refresh.
+        void set_lazy(bool lazy) {
+            if (!lazy) {
+                refresh();
+            }
+            _lazy = lazy;
+        }
+
+        [[nodiscard]] bool is_lazy() const {
+            return _lazy;
+        }
+
+        [[nodiscard]] bool is_dirty() const {
+            return _dirty;
+        }
+
+        void refresh() {
+            if (_dirty) {
+                pack_pools();
+            }
+        }
+
+        // Read-only access can't repack, and the packed range of a dirty lazy group is stale
+        void require_packed() const {
+            if (_dirty) {
+                throw std::runtime_error("Lazy group has to be refreshed before read-only iteration");
+            }
+        }
+
         template<typename T>
         [[nodiscard]] bool own() const {
             return own(type_index<T>::value());
@@ -36,9 +83,32 @@ namespace fecs {
             return (own(type_index<Ts>::value()) && ...);
         }
 
+        [[nodiscard]] group_stats stats() const {
+            group_stats s;
+            s.next_index = _next_index;
+            s.emplace_swaps = _emplace_swaps;
+            s.remove_swaps = _remove_swaps;
+            s.iterations = _iterations.load(std::memory_order_relaxed);
+            s.iterated_entities = _iterated_entities.load(std::memory_order_relaxed);
+            return s;
+        }
+
     protected:
         size_t _next_index = 0;
-
+        size_t _emplace_swaps = 0;
+        size_t _remove_swaps = 0;
+        // Version changes of the first pool caused by adding and removing members
+        uint64_t _member_swaps = 0;
+        bool _lazy = false;
+        bool _dirty = false;
+        // Counted from const for_each too, which may run on several threads
+        mutable std::atomic<size_t> _iterations = 0;
+        mutable std::atomic<size_t> _iterated_entities = 0;
+
+        void count_iteration(size_t entities) const {
+            _iterations.fetch_add(1, std::memory_order_relaxed);
+            _iterated_entities.fetch_add(entities, std::memory_order_relaxed);
+        }
 
     };
 
@@ -56,7 +126,7 @@ namespace fecs {
             }
         }
 
-        [[nodiscard]] bool contains(const entity_t entity) const {
+        [[nodiscard]] bool contains(const entity_t entity) const override {
             for(const pool* p : _pools){
                 if(!p->contains(entity)){
                     return false;
@@ -69,18 +139,31 @@ namespace fecs {
             return ((type_index<Ts>::value() == id_index) || ...);
         }
 
+        // Order of the packed range for cursors. Members join right after it and leave
+        // by swapping with its last entity, neither moves an entity inside it past a cursor.
+        [[nodiscard]] uint64_t order_version() const {
+            return _pools[0]->order_version() - _member_swaps;
+        }
+
         void pack_pools() override {
+            FECS_PROFILE_SCOPE("fecs::group::pack_pools");
             const pool* min_pool = *std::min_element(_pools.begin(), _pools.end(),
                 [](const pool* a, const pool* b) {
                     return a->size() < b->size();
                 });
             const auto& entities = min_pool->get_keys();
 
+            _next_index = 0;
+            _dirty = false;
+
             if(entities.empty()){
                 return;
             }
 
-            _next_index = 0;
+            if (entities.size() >= bulk_pack_threshold) {
+                bulk_pack(entities);
+                return;
+            }
 
             for(size_t i = 0; i < entities.size(); i++) {
                 if(contains(entities[i])){
@@ -95,29 +178,80 @@ namespace fecs {
         }
 
         void trigger_emplace(entity_t entity) override{
+            FECS_PROFILE_SCOPE("fecs::group::trigger_emplace");
+            if (_lazy) {
+                _dirty = true;
+                return;
+            }
             if(contains(entity)){
                 entity_t target = _pools[0]->get_key_by_index(_next_index);
+                const uint64_t version = _pools[0]->version();
                 for(pool* p : _pools){
                     p->swap(target, entity);
                 }
+                _member_swaps += _pools[0]->version() - version;
+                _emplace_swaps += _pools.size();
                 _next_index++;
             }
         }
 
+        // Only the packed range is maintained here, the pool removes the entity itself
         void trigger_remove(entity_t entity) override{
+            FECS_PROFILE_SCOPE("fecs::group::trigger_remove");
+            if (_lazy) {
+                _dirty = true;
+                return;
+            }
             if(contains(entity)){
                 size_t last_packed_index = --_next_index;
                 const entity_t target = _pools[0]->get_key_by_index(last_packed_index);
+                const uint64_t version = _pools[0]->version();
                 for (pool *p : _pools) {
                     p->swap(entity, target);
-                    remove_by_self(p, entity);
                 }
+                _member_swaps += _pools[0]->version() - version;
+                _remove_swaps += _pools.size();
             }
         }
 
     protected:
+        // Below this many candidates the group is packed with per-entity swaps
+        static constexpr size_t bulk_pack_threshold = 4096;
+        // Minimal number of candidates tested by one thread
+        static constexpr size_t parallel_pack_chunk = 65536;
+
         pools_array _pools;
 
+        // Membership is tested in parallel chunks, then every pool is partitioned in a single pass
+        void bulk_pack(const pool::keys_container& entities) {
+            std::vector<uint8_t, aligned_allocator<uint8_t, cache_line_size>> member(entities.size());
+            parallel_for(entities.size(), parallel_pack_chunk, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i) {
+                    const size_t page = entities[i] / SPARSE_MAX_SIZE;
+                    const size_t offset = entities[i] % SPARSE_MAX_SIZE;
+                    bool passed = true;
+                    for (const pool* p : _pools) {
+                        if (!p->contains(page, offset)) {
+                            passed = false;
+                            break;
+                        }
+                    }
+                    member[i] = passed;
+                }
+            }, cache_line_size);
+
+            pool::keys_container front;
+            for (size_t i = 0; i < entities.size(); ++i) {
+                if (member[i]) {
+                    front.push_back(entities[i]);
+                }
+            }
+            for (pool* p : _pools) {
+                p->arrange_front(front);
+            }
+            _next_index = front.size();
+        }
+
         entity_t find_swapable(pool* p, size_t start_index){
             const auto& entities = p->get_keys();
 
@@ -136,10 +270,10 @@ namespace fecs {
             return error_entity;
         }
 
-        template<size_t index>
+        template<size_t index, bool read_only = false>
         auto get_pool() const {
             using component_t = typename components::template get<index>;
-            return static_cast<sparse_set<component_t>*>(_pools[index]);
+            return static_cast<maybe_const_t<read_only, sparse_set<component_t>>*>(_pools[index]);
         }
 
         template<typename T, size_t... Is>
@@ -5,7 +5,16 @@
 #ifndef GROUP_VIEW_H
 #define GROUP_VIEW_H
 
+#include <algorithm>
+#include <array>
+#include <tuple>
+
+#include "group_base.h"
+#include "iterators.h"
+#include "view.h"
 #include "../containers/sparse_set.h"
+#include "../util/log.h"
+#include "../util/profile.h"
 
 namespace fecs {
 
@@ -19,35 +28,99 @@ namespace fecs {
         using p_components = type_list<Ts...>;
         using p_pools_array = std::array<pool*, p_components::size>;
 
-        group_slice(const p_pools_array& pools, const size_t* next_index) : _pools(pools), _next_index(next_index)  {}
+        group_slice(const p_pools_array& pools, group_descriptor* owner) : _pools(pools), _group(owner)  {}
 
         template<typename Func>
         requires std::is_invocable_v<Func, Ts&...> || std::is_invocable_v<Func, entity_t, Ts&...>
         void for_each(Func func) {
-            for_each_impl(func, p_components::sequence);
+            _group->refresh();
+            for_each_impl<false>(func, p_components::sequence);
+        }
+
+        template<typename Func>
+        requires std::is_invocable_v<Func, const Ts&...> || std::is_invocable_v<Func, entity_t, const Ts&...>
+        void for_each(Func func) const {
+            if (_group->is_dirty()) {
+                for_each_unpacked(fecs::view<Ts...>(_pools), func);
+                return;
+            }
+            for_each_impl<true>(func, p_components::sequence);
+        }
+
+        using iterator = packed_iterator<Ts...>;
+        using const_iterator = packed_iterator<const Ts...>;
+
+        [[nodiscard]] iterator begin() {
+            _group->refresh();
+            return make_iterator<false>(0, p_components::sequence);
+        }
+
+        [[nodiscard]] iterator end() {
+            _group->refresh();
+            return make_iterator<false>(_group->size(), p_components::sequence);
+        }
+
+        [[nodiscard]] const_iterator begin() const {
+            _group->require_packed();
+            return make_iterator<true>(0, p_components::sequence);
+        }
+
+        [[nodiscard]] const_iterator end() const {
+            _group->require_packed();
+            return make_iterator<true>(_group->size(), p_components::sequence);
+        }
+
+        [[nodiscard]] size_t size() const {
+            return _group->size();
         }
 
     private:
         p_pools_array _pools;
-        const size_t *const _next_index = nullptr;
+        // Group owning the sliced components, its size is the packed range
+        group_descriptor* _group = nullptr;
 
-        template<size_t index>
+        // Read-only passes over a dirty group can't repack it, so the slice pools are looked up
+        // like a view and entities missing other owned components of the group are skipped
+        template<typename Func>
+        void for_each_unpacked(const fecs::view<Ts...>& unpacked, Func& func) const {
+            unpacked.for_each([this, &func](entity_t e, const Ts&... components) {
+                if (!_group->contains(e)) {
+                    return;
+                }
+                if constexpr (std::is_invocable_v<Func&, const Ts&...>) {
+                    func(components...);
+                }
+                else {
+                    func(e, components...);
+                }
+            });
+        }
+
+        template<bool read_only, size_t... Is>
+        auto make_iterator(size_t index, std::index_sequence<Is...>) const {
+            using iterator_t = std::conditional_t<read_only, const_iterator, iterator>;
+            return iterator_t(_pools[0], typename iterator_t::pools_tuple(get_pool<Is, read_only>()...), index);
+        }
+
+        template<size_t index, bool read_only = false>
         auto get_pool() const {
             using component_t = typename p_components::template get<index>;
-            return static_cast<sparse_set<component_t>*>(_pools[index]);
+            return static_cast<maybe_const_t<read_only, sparse_set<component_t>>*>(_pools[index]);
         }
 
-        template<typename Func, size_t... Is>
+        template<bool read_only, typename Func, size_t... Is>
         void for_each_impl(Func func, std::index_sequence<Is...>) const {
-            if constexpr (std::is_invocable_v<Func, Ts&...>) {
-                for (size_t i = 0; i < *_next_index; ++i) {
-                    func(get_pool<Is>()->get_ref_directly(i)...);
+            FECS_PROFILE_SCOPE("fecs::group_slice::for_each");
+            const size_t count = _group->size();
+            if constexpr (std::is_invocable_v<Func, maybe_const_t<read_only, Ts>&...>) {
+                for (size_t i = 0; i < count; ++i) {
+                    func(get_pool<Is, read_only>()->get_ref_directly(i)...);
                 }
             }
             else {
                 const pool* first_pool = _pools[0];
-                for (size_t i = 0; i < *_next_index; ++i) {
-                    func(first_pool->get_key_by_index(i), get_pool<Is>()->get_ref_directly(i)...);
+                for (size_t i = 0; i < count; ++i) {
+                    func(first_pool->get_key_by_index(i), get_pool<Is, read_only>()->get_ref_directly(i)...);
                 }
             }
         }
@@ -61,40 +134,133 @@ namespace fecs {
         using p_components = type_list<PTs...>;
         using v_components = type_list<VTs...>;
         using p_pools_array = std::array<pool*, p_components::size>;
-        using v_pools_array = std::array<pool*, p_components::size>;
+        using v_pools_array = std::array<pool*, v_components::size>;
 
-        group_slice(const p_pools_array& p_pools, const v_pools_array& v_pools, const size_t* next_index)
-            : _p_pools(p_pools), _v_pools(v_pools), _next_index(next_index)  {}
+        group_slice(const p_pools_array& p_pools, const v_pools_array& v_pools, group_descriptor* owner)
+            : _p_pools(p_pools), _v_pools(v_pools), _group(owner)  {}
 
         template<typename Func>
         requires std::is_invocable_v<Func, PTs&..., VTs&...> || std::is_invocable_v<Func, entity_t, PTs&..., VTs&...>
         void for_each(Func func) {
-            for_each_impl(func, p_components::sequence, v_components::sequence);
+            _group->refresh();
+            for_each_impl<false>(func, p_components::sequence, v_components::sequence);
+        }
+
+        template<typename Func>
+        requires std::is_invocable_v<Func, const PTs&..., const VTs&...> || std::is_invocable_v<Func, entity_t, const PTs&..., const VTs&...>
+        void for_each(Func func) const {
+            if (_group->is_dirty()) {
+                for_each_unpacked(unpacked_view(), func);
+                return;
+            }
+            for_each_impl<true>(func, p_components::sequence, v_components::sequence);
+        }
+
+        using iterator = filter_iterator<group_slice, false>;
+        using const_iterator = filter_iterator<group_slice, true>;
+
+        [[nodiscard]] iterator begin() {
+            _group->refresh();
+            return iterator(this, 0, _group->size());
+        }
+
+        [[nodiscard]] iterator end() {
+            _group->refresh();
+            return iterator(this, _group->size(), _group->size());
+        }
+
+        [[nodiscard]] const_iterator begin() const {
+            _group->require_packed();
+            return const_iterator(this, 0, _group->size());
+        }
+
+        [[nodiscard]] const_iterator end() const {
+            _group->require_packed();
+            return const_iterator(this, _group->size(), _group->size());
         }
 
     private:
+        template<typename, bool>
+        friend class filter_iterator;
+
         p_pools_array _p_pools;
         v_pools_array _v_pools;
-        const size_t *const _next_index = nullptr;
+        // Group owning the sliced components, its size is the packed range
+        group_descriptor* _group = nullptr;
+
+        // Read-only passes over a dirty group can't repack it, so the slice pools are looked up
+        // like a view and entities missing other owned components of the group are skipped
+        template<typename Func>
+        void for_each_unpacked(const fecs::view<PTs..., VTs...>& unpacked, Func& func) const {
+            unpacked.for_each([this, &func](entity_t e, const PTs&... packed, const VTs&... viewed) {
+                if (!_group->contains(e)) {
+                    return;
+                }
+                if constexpr (std::is_invocable_v<Func&, const PTs&..., const VTs&...>) {
+                    func(packed..., viewed...);
+                }
+                else {
+                    func(e, packed..., viewed...);
+                }
+            });
+        }
+
+        [[nodiscard]] fecs::view<PTs..., VTs...> unpacked_view() const {
+            std::array<pool*, p_components::size + v_components::size> pools;
+            std::copy(_p_pools.begin(), _p_pools.end(), pools.begin());
+            std::copy(_v_pools.begin(), _v_pools.end(), pools.begin() + p_components::size);
+            return fecs::view<PTs..., VTs...>(pools);
+        }
+
+        [[nodiscard]] bool accepts(size_t index) const {
+            const entity_t e = _p_pools[0]->get_key_by_index(index);
+            const size_t page = e / SPARSE_MAX_SIZE;
+            const size_t offset = e % SPARSE_MAX_SIZE;
+            for (size_t j = 0; j < v_components::size; ++j) {
+                if (!_v_pools[j]->contains(page, offset)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        template<bool read_only>
+        auto fetch(size_t index) const {
+            return fetch_impl<read_only>(index, p_components::sequence, v_components::sequence);
+        }
+
+        template<bool read_only, size_t... PIs, size_t... VIs>
+        auto fetch_impl(size_t index, std::index_sequence<PIs...>, std::index_sequence<VIs...>) const {
+            const entity_t e = _p_pools[0]->get_key_by_index(index);
+            const size_t page = e / SPARSE_MAX_SIZE;
+            const size_t offset = e % SPARSE_MAX_SIZE;
+            return std::tuple<entity_t, maybe_const_t<read_only, PTs>&..., maybe_const_t<read_only, VTs>&...>(e,
+                get_pack_pool<PIs, read_only>()->get_ref_directly(index)...,
+                get_view_pool<VIs, read_only>()->get_ref_directly_e(page, offset)...);
+        }
 
-        template<size_t index>
+        template<size_t index, bool read_only = false>
         auto get_pack_pool() const {
             using component_t = typename p_components::template get<index>;
-            return static_cast<sparse_set<component_t>*>(_p_pools[index]);
+            return static_cast<maybe_const_t<read_only, sparse_set<component_t>>*>(_p_pools[index]);
         }
 
-        template<size_t index>
+        template<size_t index, bool read_only = false>
         auto get_view_pool() const {
             using component_t = typename v_components::template get<index>;
-            return static_cast<sparse_set<component_t>*>(_v_pools[index]);
+            return static_cast<maybe_const_t<read_only, sparse_set<component_t>>*>(_v_pools[index]);
         }
 
-        template<typename Func, size_t... PIs, size_t... VIs>
-        void for_each_impl(Func func, std::index_sequence<PIs...>, std::index_sequence<VIs...>) {
+        template<bool read_only, typename Func, size_t... PIs, size_t... VIs>
+        void for_each_impl(Func func, std::index_sequence<PIs...>, std::index_sequence<VIs...>) const {
+            FECS_PROFILE_SCOPE("fecs::group_slice::for_each");
+            const size_t count = _group->size();
             const pool* first_pool = _p_pools[0];
+            const auto& keys = first_pool->get_keys();
 
-            if constexpr (std::is_invocable_v<Func, PTs&..., VTs&...>) {
-                for (size_t i = 0; i < *_next_index; ++i) {
+            if constexpr (std::is_invocable_v<Func, maybe_const_t<read_only, PTs>&..., maybe_const_t<read_only, VTs>&...>) {
+                for (size_t i = 0; i < count; ++i) {
+                    prefetch_lookups(keys, i, count, get_view_pool<VIs, true>()...);
                     const entity_t e = first_pool->get_key_by_index(i);
                     const size_t page = e / SPARSE_MAX_SIZE;
                     const size_t offset = e % SPARSE_MAX_SIZE;
@@ -107,13 +273,14 @@ namespace fecs {
                         }
                     }
                     if (passed) {
-                        func(get_pack_pool<PIs>()->get_ref_directly(i)...,
-                             get_view_pool<VIs>()->get_ref_directly_e(page, offset)...);
+                        func(get_pack_pool<PIs, read_only>()->get_ref_directly(i)...,
+                             get_view_pool<VIs, read_only>()->get_ref_directly_e(page, offset)...);
                     }
                 }
             }
             else {
-                for (size_t i = 0; i < *_next_index; ++i) {
+                for (size_t i = 0; i < count; ++i) {
+                    prefetch_lookups(keys, i, count, get_view_pool<VIs, true>()...);
                     const entity_t e = first_pool->get_key_by_index(i);
                     const size_t page = e / SPARSE_MAX_SIZE;
                     const size_t offset = e % SPARSE_MAX_SIZE;
@@ -127,8 +294,8 @@ namespace fecs {
                     }
                     if (passed) {
                         func(e,
-                             get_pack_pool<PIs>()->get_ref_directly(i)...,
-                             get_view_pool<VIs>()->get_ref_directly_e(page, offset)...);
+                             get_pack_pool<PIs, read_only>()->get_ref_directly(i)...,
+                             get_view_pool<VIs, read_only>()->get_ref_directly_e(page, offset)...);
                     }
                 }
             }
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+
+#include "../containers/pool.h"
+#include "../containers/sparse_set.h"
+#include "../core/types.h"
+
+namespace fecs {
+
+    // Walks pools that share the same order (runner, owning part of a group) by index.
+    // Dereferencing yields std::tuple<entity_t, Ts&...>, Ts may be const for read-only iteration.
+    template<typename... Ts>
+    class packed_iterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using iterator_concept = std::random_access_iterator_tag;
+        using value_type = std::tuple<entity_t, Ts&...>;
+        using reference = value_type;
+        using pointer = void;
+        using difference_type = std::ptrdiff_t;
+        using pools_tuple = std::tuple<maybe_const_t<std::is_const_v<Ts>, sparse_set<std::remove_const_t<Ts>>>*...>;
+
+        packed_iterator() = default;
+
+        packed_iterator(const pool* keys, const pools_tuple& pools, size_t index)
+            : _keys(keys), _pools(pools), _index(index) {}
+
+        reference operator*() const {
+            return (*this)[0];
+        }
+
+        reference operator[](difference_type n) const {
+            const size_t i = _index + static_cast<size_t>(n);
+            return std::apply([&](auto*... p) {
+                return reference(_keys->get_key_by_index(i), p->get_ref_directly(i)...);
+            }, _pools);
+        }
+
+        packed_iterator& operator++() { ++_index; return *this; }
+        packed_iterator operator++(int) { packed_iterator tmp = *this; ++_index; return tmp; }
+        packed_iterator& operator--() { --_index; return *this; }
+        packed_iterator operator--(int) { packed_iterator tmp = *this; --_index; return tmp; }
+
+        packed_iterator& operator+=(difference_type n) { _index += static_cast<size_t>(n); return *this; }
+        packed_iterator& operator-=(difference_type n) { _index -= static_cast<size_t>(n); return *this; }
+        friend packed_iterator operator+(packed_iterator it, difference_type n) { return it += n; }
+        friend packed_iterator operator+(difference_type n, packed_iterator it) { return it += n; }
+        friend packed_iterator operator-(packed_iterator it, difference_type n) { return it -= n; }
+        friend difference_type operator-(const packed_iterator& a, const packed_iterator& b) {
+            return static_cast<difference_type>(a._index) - static_cast<difference_type>(b._index);
+        }
+
+        friend bool operator==(const packed_iterator& a, const packed_iterator& b) { return a._index == b._index; }
+        friend auto operator<=>(const packed_iterator& a, const packed_iterator& b) { return a._index <=> b._index; }
+
+    private:
+        const pool* _keys = nullptr;
+        pools_tuple _pools{};
+        size_t _index = 0;
+
+    };
+
+    // Walks indices [0, end) of a queue and stops only at accepted ones (view, view part of a group).
+    // Queue provides accepts(index) and fetch<read_only>(index).
+    template<typename Queue, bool read_only>
+    class filter_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using iterator_concept = std::forward_iterator_tag;
+        using reference = decltype(std::declval<const Queue&>().template fetch<read_only>(size_t{}));
+        using value_type = reference;
+        using pointer = void;
+        using difference_type = std::ptrdiff_t;
+
+        filter_iterator() = default;
+
+        filter_iterator(const Queue* queue, size_t index, size_t end)
+            : _queue(queue), _index(index), _end(end) {
+            skip();
+        }
+
+        reference operator*() const {
+            return _queue->template fetch<read_only>(_index);
+        }
+
+        filter_iterator& operator++() {
+            ++_index;
+            skip();
+            return *this;
+        }
+
+        filter_iterator operator++(int) {
+            filter_iterator tmp = *this;
+            ++(*this);
+            return tmp;
+        }
+
+        friend bool operator==(const filter_iterator& a, const filter_iterator& b) {
+            return a._index == b._index;
+        }
+
+    private:
+        const Queue* _queue = nullptr;
+        size_t _index = 0;
+        size_t _end = 0;
+
+        void skip() {
+            while (_index < _end && !_queue->accepts(_index)) {
+                ++_index;
+            }
+        }
+
+    };
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <type_traits>
+
+#include "view.h"
+#include "../core/type_traits.h"
+#include "../core/types.h"
+#include "../util/stats.h"
+
+namespace fecs {
+
+    class query_descriptor {
+    public:
+        virtual ~query_descriptor() = default;
+
+        [[nodiscard]] virtual query_stats stats() const = 0;
+
+    protected:
+        size_t _replans = 0;
+        size_t _iterations = 0;
+    };
+
+    // Persistent view owned by the registry. Pools are resolved once, the view
+    // plans every for_each and replans counts how often the driving pool changed.
+    template<typename... Ts>
+    requires unique_types<Ts...> && (sizeof...(Ts) > 1)
+    class query : public query_descriptor {
+    public:
+        using view_t = fecs::view<Ts...>;
+        using components = typename view_t::components;
+        using pools_array = typename view_t::pools_array;
+
+        explicit query(const pools_array& pools)
+            : _view(pools) {}
+
+        template<typename Func>
+        requires std::is_invocable_v<Func, Ts&...> || std::is_invocable_v<Func, entity_t, Ts&...>
+        void for_each(Func func) {
+            const pool* driving = _view.driving_pool();
+            _iterations++;
+            _view.for_each(func);
+            if (_view.driving_pool() != driving) {
+                _replans++;
+            }
+        }
+
+        [[nodiscard]] query_stats stats() const override {
+            query_stats s;
+            const pool* driving = _view.driving_pool();
+            s.driving_pool_size = driving != nullptr ? driving->size() : 0;
+            s.replans = _replans;
+            s.iterations = _iterations;
+            return s;
+        }
+
+        [[nodiscard]] view_t& get_view() {
+            return _view;
+        }
+
+    private:
+        view_t _view;
+
+    };
+
+}
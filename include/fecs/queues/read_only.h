@@ -0,0 +1,41 @@
+#pragma once
+
+#include <utility>
+
+#include "cursor.h"
+
+namespace fecs {
+
+    // Wraps a queue so that only its const for_each is reachable.
+    // Any number of read_only queues may iterate the same pools concurrently
+    // as long as nothing modifies the registry meanwhile.
+    template<typename Queue>
+    class read_only {
+    public:
+        explicit read_only(Queue queue)
+            : _queue(std::move(queue)) {}
+
+        template<typename Func>
+        void for_each(Func func) const {
+            _queue.for_each(func);
+        }
+
+        template<typename Func>
+        bool for_each(cursor& c, cursor_budget budget, Func func) const {
+            return _queue.for_each(c, budget, func);
+        }
+
+        [[nodiscard]] auto begin() const {
+            return _queue.begin();
+        }
+
+        [[nodiscard]] auto end() const {
+            return _queue.end();
+        }
+
+    private:
+        const Queue _queue;
+
+    };
+
+}
@@ -1,7 +1,10 @@
 #pragma once
 
+#include "cursor.h"
+#include "iterators.h"
 #include "../core/type_traits.h"
 #include "../containers/sparse_set.h"
+#include "../util/profile.h"
 
 namespace fecs {
 
@@ -9,19 +12,92 @@ namespace fecs {
     class runner{
     public:
         using sparse_set_t = sparse_set<T>;
+        using iterator = packed_iterator<T>;
+        using const_iterator = packed_iterator<const T>;
 
         runner(sparse_set_t* sst)
             : _pool(sst) {}
 
         template<typename Func>
         requires std::is_invocable_v<Func, T&> || std::is_invocable_v<Func, entity_t, T&>
+              || (sparse_set_t::is_tag && std::is_invocable_v<Func, entity_t>)
         void for_each(Func func){
-            _pool->for_each(func);
+            FECS_PROFILE_SCOPE("fecs::runner::for_each");
+            if (_pool != nullptr) {
+                _pool->for_each(func);
+            }
         }
-        
+
+        template<typename Func>
+        requires std::is_invocable_v<Func, const T&> || std::is_invocable_v<Func, entity_t, const T&>
+              || (sparse_set_t::is_tag && std::is_invocable_v<Func, entity_t>)
+        void for_each(Func func) const {
+            FECS_PROFILE_SCOPE("fecs::runner::for_each");
+            if (_pool != nullptr) {
+                static_cast<const sparse_set_t*>(_pool)->for_each(func);
+            }
+        }
+
+        // Visits at most budget entities per call and continues where the previous call
+        // stopped, returns true once the pass over every entity is complete
+        template<typename Func>
+        requires std::is_invocable_v<Func, T&> || std::is_invocable_v<Func, entity_t, T&>
+              || (sparse_set_t::is_tag && std::is_invocable_v<Func, entity_t>)
+        bool for_each(cursor& c, cursor_budget budget, Func func) {
+            return for_each_cursor_impl<false>(c, budget, func);
+        }
+
+        template<typename Func>
+        requires std::is_invocable_v<Func, const T&> || std::is_invocable_v<Func, entity_t, const T&>
+              || (sparse_set_t::is_tag && std::is_invocable_v<Func, entity_t>)
+        bool for_each(cursor& c, cursor_budget budget, Func func) const {
+            return for_each_cursor_impl<true>(c, budget, func);
+        }
+
+        [[nodiscard]] iterator begin() {
+            return iterator(_pool, typename iterator::pools_tuple(_pool), 0);
+        }
+
+        [[nodiscard]] iterator end() {
+            return iterator(_pool, typename iterator::pools_tuple(_pool), size());
+        }
+
+        [[nodiscard]] const_iterator begin() const {
+            return const_iterator(_pool, typename const_iterator::pools_tuple(_pool), 0);
+        }
+
+        [[nodiscard]] const_iterator end() const {
+            return const_iterator(_pool, typename const_iterator::pools_tuple(_pool), size());
+        }
+
+        [[nodiscard]] size_t size() const {
+            return _pool != nullptr ? _pool->size() : 0;
+        }
+
     private:
         sparse_set_t* _pool;
 
+        template<bool read_only, typename Func>
+        bool for_each_cursor_impl(cursor& c, cursor_budget budget, Func func) const {
+            FECS_PROFILE_SCOPE("fecs::runner::for_each");
+            if (_pool == nullptr) {
+                c.reset();
+                return true;
+            }
+            maybe_const_t<read_only, sparse_set_t>* p = _pool;
+            return c.advance(*p, [p] { return p->size(); }, budget, [&](size_t i) {
+                if constexpr (std::is_invocable_v<Func, maybe_const_t<read_only, T>&>) {
+                    func(p->get_ref_directly(i));
+                }
+                else if constexpr (sparse_set_t::is_tag && std::is_invocable_v<Func, entity_t>) {
+                    func(p->get_key_by_index(i));
+                }
+                else {
+                    func(p->get_key_by_index(i), p->get_ref_directly(i));
+                }
+            });
+        }
+
     };
 
 }
\ No newline at end of file
@@ -2,12 +2,20 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
+#include <limits>
+#include <span>
+#include <tuple>
 #include <type_traits>
 #include <utility>
 
+#include "cursor.h"
+#include "iterators.h"
+#include "../containers/dense_bitset.h"
 #include "../containers/sparse_set.h"
 #include "../core/type_traits.h"
 #include "../core/types.h"
+#include "../util/profile.h"
 
 namespace fecs {
 
@@ -17,33 +25,175 @@ namespace fecs {
     public:
         using components = type_list<Ts...>;
         using pools_array = std::array<pool*, components::size>;
-        using pools_to_check = std::array<pool*, components::size - 1>;
 
         view(const pools_array& pools)
             : _pools(pools) {
                 update_min_pool();
             }
 
+        // Plans again with the current pool sizes and check statistics.
+        // for_each does this on every call, iterators and cursors use the last plan.
         void update_min_pool() {
-            _min_pool = get_min_pool();
-            size_t idx = 0;
-            for (size_t i = 0; i < components::size; ++i) {
-                if (_pools[i] != _min_pool) {
-                    _checks[idx++] = _pools[i];
-                }
-            }
+            _plan = make_plan();
         }
 
         template<typename Func>
         requires std::is_invocable_v<Func, Ts&...> || std::is_invocable_v<Func, entity_t, Ts&...>
         void for_each(Func func){
-            for_each_impl(func, components::sequence);
+            update_min_pool();
+            if (_plan.driving == nullptr) {
+                return;
+            }
+            if (use_membership(_plan)) {
+                for_each_membership_impl<false>(func, components::sequence);
+                return;
+            }
+            for_each_impl<false>(_plan, func, components::sequence);
+        }
+
+        // Read-only path, several readers can share the pools
+        template<typename Func>
+        requires std::is_invocable_v<Func, const Ts&...> || std::is_invocable_v<Func, entity_t, const Ts&...>
+        void for_each(Func func) const {
+            const plan p = make_plan();
+            if (p.driving == nullptr) {
+                return;
+            }
+            if (use_membership(p)) {
+                for_each_membership_impl<true>(func, components::sequence);
+                return;
+            }
+            for_each_impl<true>(p, func, components::sequence);
+        }
+
+        // Iterates only the given entities, e.g. results of an index or spatial query
+        template<typename Func>
+        requires std::is_invocable_v<Func, Ts&...> || std::is_invocable_v<Func, entity_t, Ts&...>
+        void for_each(std::span<const entity_t> entities, Func func) {
+            if (_plan.driving == nullptr) {
+                return;
+            }
+            for_each_subset_impl<false>(entities, func, components::sequence);
+        }
+
+        template<typename Func>
+        requires std::is_invocable_v<Func, const Ts&...> || std::is_invocable_v<Func, entity_t, const Ts&...>
+        void for_each(std::span<const entity_t> entities, Func func) const {
+            if (_plan.driving == nullptr) {
+                return;
+            }
+            for_each_subset_impl<true>(entities, func, components::sequence);
+        }
+
+        // Visits at most budget entities of the driving pool per call and continues where
+        // the previous call stopped, returns true once the pass is complete
+        template<typename Func>
+        requires std::is_invocable_v<Func, Ts&...> || std::is_invocable_v<Func, entity_t, Ts&...>
+        bool for_each(cursor& c, cursor_budget budget, Func func) {
+            return for_each_cursor_impl<false>(c, budget, func, components::sequence);
+        }
+
+        template<typename Func>
+        requires std::is_invocable_v<Func, const Ts&...> || std::is_invocable_v<Func, entity_t, const Ts&...>
+        bool for_each(cursor& c, cursor_budget budget, Func func) const {
+            return for_each_cursor_impl<true>(c, budget, func, components::sequence);
+        }
+
+        [[nodiscard]] const pool* driving_pool() const {
+            return _plan.driving;
+        }
+
+        // Indices of the other pools in the order their membership is checked
+        [[nodiscard]] const std::array<size_t, components::size - 1>& check_order() const {
+            return _plan.checks;
+        }
+
+        // Yields std::tuple<entity_t, Ts&...>, walks the driving pool and skips entities missing a component
+        using iterator = filter_iterator<view, false>;
+        using const_iterator = filter_iterator<view, true>;
+
+        [[nodiscard]] iterator begin() {
+            return iterator(this, 0, driving_size());
+        }
+
+        [[nodiscard]] iterator end() {
+            return iterator(this, driving_size(), driving_size());
+        }
+
+        [[nodiscard]] const_iterator begin() const {
+            return const_iterator(this, 0, driving_size());
+        }
+
+        [[nodiscard]] const_iterator end() const {
+            return const_iterator(this, driving_size(), driving_size());
         }
 
     private:
+        template<typename, bool>
+        friend class filter_iterator;
+
+        // The smallest pool drives the iteration, the others are checked
+        // with the ones that rejected most entities so far first
+        struct plan {
+            pool* driving = nullptr;
+            std::array<size_t, components::size - 1> checks {};
+        };
+
+        using rejections_array = std::array<size_t, components::size - 1>;
+
         pools_array _pools;
-        pools_to_check _checks;
-        pool* _min_pool;
+        plan _plan;
+
+        [[nodiscard]] size_t driving_size() const {
+            return _plan.driving != nullptr ? _plan.driving->size() : 0;
+        }
+
+        [[nodiscard]] bool accepts(size_t index) const {
+            const entity_t e = _plan.driving->get_key_by_index(index);
+            return first_failed_check(_plan, e / SPARSE_MAX_SIZE, e % SPARSE_MAX_SIZE) == _plan.checks.size();
+        }
+
+        // Position in p.checks of the first pool missing the entity, p.checks.size() if none is
+        [[nodiscard]] size_t first_failed_check(const plan& p, size_t page, size_t offset) const {
+            return first_failed_check(p, page, offset, std::make_index_sequence<components::size - 1>{});
+        }
+
+        template<size_t... Position>
+        [[nodiscard]] size_t first_failed_check(const plan& p, size_t page, size_t offset, std::index_sequence<Position...>) const {
+            size_t failed = p.checks.size();
+            ((contains_at(p.checks[Position], page, offset, components::sequence) || (failed = Position, false)) && ...);
+            return failed;
+        }
+
+        // Pools are checked through their concrete type, so the lookups are not virtual calls
+        template<size_t... It>
+        [[nodiscard]] bool contains_at(size_t index, size_t page, size_t offset, std::index_sequence<It...>) const {
+            bool found = false;
+            ((index == It && (found = get_pool<It, true>()->contains(page, offset), true)) || ...);
+            return found;
+        }
+
+        // Every check sees the entities that passed the ones before it
+        void record_checks(const plan& p, size_t driven, const rejections_array& rejections) const {
+            for (size_t i = 0; i < p.checks.size(); ++i) {
+                _pools[p.checks[i]]->record_checks(driven, rejections[i]);
+                driven -= rejections[i];
+            }
+        }
+
+        template<bool read_only>
+        auto fetch(size_t index) const {
+            return fetch_impl<read_only>(index, components::sequence);
+        }
+
+        template<bool read_only, size_t... It>
+        auto fetch_impl(size_t index, std::index_sequence<It...>) const {
+            const entity_t e = _plan.driving->get_key_by_index(index);
+            const size_t page = e / SPARSE_MAX_SIZE;
+            const size_t offset = e % SPARSE_MAX_SIZE;
+            return std::tuple<entity_t, maybe_const_t<read_only, Ts>&...>(e,
+                get_pool<It, read_only>()->get_ref_directly_e(page, offset)...);
+        }
 
         bool contains(entity_t entity) const{
             for(size_t i = 0; i < components::size; ++i){
@@ -54,62 +204,170 @@ namespace fecs {
             return true;
         }
 
-        template<size_t index>
+        template<size_t index, bool read_only = false>
         auto get_pool() const {
             using component_t = typename components::template get<index>;
-            return static_cast<sparse_set<component_t>*>(_pools[index]);
+            return static_cast<maybe_const_t<read_only, sparse_set<component_t>>*>(_pools[index]);
+        }
+
+        // A missing pool means the view is empty, so there is nothing to drive it
+        plan make_plan() const {
+            plan p;
+            if (std::find(_pools.begin(), _pools.end(), nullptr) != _pools.end()) {
+                return p;
+            }
+            std::array<size_t, components::size> sizes;
+            for (size_t i = 0; i < components::size; ++i) {
+                sizes[i] = _pools[i]->size();
+            }
+            const size_t driving = static_cast<size_t>(std::min_element(sizes.begin(), sizes.end()) - sizes.begin());
+            const size_t largest = std::max<size_t>(*std::max_element(sizes.begin(), sizes.end()), 1);
+            p.driving = _pools[driving];
+
+            // Until a pool has statistics, smaller pools are assumed to reject more
+            std::array<double, components::size> rates;
+            for (size_t i = 0, j = 0; i < components::size; ++i) {
+                rates[i] = _pools[i]->rejection_rate(1.0 - static_cast<double>(sizes[i]) / static_cast<double>(largest));
+                if (i != driving) {
+                    p.checks[j++] = i;
+                }
+            }
+            std::stable_sort(p.checks.begin(), p.checks.end(), [&rates](size_t a, size_t b) {
+                return rates[a] > rates[b];
+            });
+            return p;
+        }
+
+        // Words intersected at once by the membership path
+        static constexpr size_t membership_block_words = 64;
+
+        // When every pool tracks membership and the keys are dense enough to give
+        // a candidate per word on average, intersecting bitsets beats probing sparse pages
+        [[nodiscard]] bool use_membership(const plan& p) const {
+            size_t words = std::numeric_limits<size_t>::max();
+            for (const pool* pool_ptr : _pools) {
+                const dense_bitset* bits = pool_ptr->membership();
+                if (bits == nullptr) {
+                    return false;
+                }
+                words = std::min(words, bits->word_count());
+            }
+            return words <= p.driving->size();
         }
 
-        pool* get_min_pool() const {
-            return *std::min_element(_pools.begin(), _pools.end(), 
-                [](const pool* p1, const pool* p2){
-                    return p1->size() < p2->size();
-                });
+        // Visits entities in key order instead of the driving pool order
+        template<bool read_only, typename Func, size_t... It>
+        void for_each_membership_impl(Func func, std::index_sequence<It...>) const {
+            FECS_PROFILE_SCOPE("fecs::view::for_each");
+            std::array<const dense_bitset::word_t*, components::size> sources;
+            size_t words = std::numeric_limits<size_t>::max();
+            for (size_t i = 0; i < components::size; ++i) {
+                const dense_bitset* bits = _pools[i]->membership();
+                sources[i] = bits->data();
+                words = std::min(words, bits->word_count());
+            }
+
+            std::array<dense_bitset::word_t, membership_block_words> block;
+            for (size_t first = 0; first < words; first += membership_block_words) {
+                const size_t count = std::min(membership_block_words, words - first);
+                intersect_words(block.data(), sources.data(), components::size, first, count);
+                for (size_t w = 0; w < count; ++w) {
+                    dense_bitset::word_t bits = block[w];
+                    while (bits != 0) {
+                        const entity_t e = static_cast<entity_t>((first + w) * dense_bitset::word_bits + std::countr_zero(bits));
+                        bits &= bits - 1;
+                        const size_t page = e / SPARSE_MAX_SIZE;
+                        const size_t offset = e % SPARSE_MAX_SIZE;
+                        if constexpr (std::is_invocable_v<Func, maybe_const_t<read_only, Ts>&...>) {
+                            func(get_pool<It, read_only>()->get_ref_directly_e(page, offset)...);
+                        }
+                        else {
+                            func(e, get_pool<It, read_only>()->get_ref_directly_e(page, offset)...);
+                        }
+                    }
+                }
+            }
+        }
+
+        template<bool read_only, typename Func, size_t... It>
+        bool for_each_cursor_impl(cursor& c, cursor_budget budget, Func func, std::index_sequence<It...>) const {
+            FECS_PROFILE_SCOPE("fecs::view::for_each");
+            if (_plan.driving == nullptr) {
+                c.reset();
+                return true;
+            }
+            const pool* driving = _plan.driving;
+            return c.advance(*driving, [driving] { return driving->size(); }, budget, [&](size_t i) {
+                const entity_t e = driving->get_key_by_index(i);
+                const size_t page = e / SPARSE_MAX_SIZE;
+                const size_t offset = e % SPARSE_MAX_SIZE;
+                if (first_failed_check(_plan, page, offset) != _plan.checks.size()) {
+                    return;
+                }
+                if constexpr (std::is_invocable_v<Func, maybe_const_t<read_only, Ts>&...>) {
+                    func(get_pool<It, read_only>()->get_ref_directly_e(page, offset)...);
+                }
+                else {
+                    func(e, get_pool<It, read_only>()->get_ref_directly_e(page, offset)...);
+                }
+            });
+        }
+
+        template<bool read_only, typename Func, size_t... It>
+        void for_each_subset_impl(std::span<const entity_t> entities, Func func, std::index_sequence<It...>) const {
+            FECS_PROFILE_SCOPE("fecs::view::for_each");
+            for (const entity_t e : entities) {
+                const size_t page = e / SPARSE_MAX_SIZE;
+                const size_t offset = e % SPARSE_MAX_SIZE;
+                if (!(get_pool<It, true>()->contains(page, offset) && ...)) {
+                    continue;
+                }
+                if constexpr (std::is_invocable_v<Func, maybe_const_t<read_only, Ts>&...>) {
+                    func(get_pool<It, read_only>()->get_ref_directly_e(page, offset)...);
+                }
+                else {
+                    func(e, get_pool<It, read_only>()->get_ref_directly_e(page, offset)...);
+                }
+            }
         }
 
-        template<typename Func, size_t... It>
-        void for_each_impl(Func func, std::index_sequence<It...>){
-            const auto& ents = _min_pool->get_keys();
+        template<bool read_only, typename Func, size_t... It>
+        void for_each_impl(const plan& p, Func func, std::index_sequence<It...>) const {
+            FECS_PROFILE_SCOPE("fecs::view::for_each");
+            const auto& ents = p.driving->get_keys();
             const size_t s = ents.size();
-            size_t page, offset;
+            size_t page, offset, failed;
             entity_t e;
-            bool passed = true;
-            if constexpr (std::is_invocable_v<Func, Ts&...>) {
+            rejections_array rejections {};
+            if constexpr (std::is_invocable_v<Func, maybe_const_t<read_only, Ts>&...>) {
                 for(size_t i = 0; i < s; ++i){
+                    prefetch_lookups(ents, i, s, get_pool<It, true>()...);
                     e = ents[i];
                     page = e / SPARSE_MAX_SIZE;
                     offset = e % SPARSE_MAX_SIZE;
-                    for(size_t j = 0; j < components::size - 1; ++j){
-                        if(!_checks[j]->contains(page, offset)){
-                            passed = false;
-                            break;
-                        }
+                    failed = first_failed_check(p, page, offset);
+                    if (failed != p.checks.size()) {
+                        ++rejections[failed];
+                        continue;
                     }
-                    if (!passed) {
-                        passed = true;
-                        break;
-                    }
-                    func(get_pool<It>()->get_ref_directly_e(page, offset)...);
+                    func(get_pool<It, read_only>()->get_ref_directly_e(page, offset)...);
                 }
             }
             else {
                 for(size_t i = 0; i < s; ++i) {
+                    prefetch_lookups(ents, i, s, get_pool<It, true>()...);
                     e = ents[i];
                     page = e / SPARSE_MAX_SIZE;
                     offset = e % SPARSE_MAX_SIZE;
-                    for(size_t j = 0; j < components::size - 1; ++j){
-                        if(!_checks[j]->contains(page, offset)){
-                            passed = false;
-                            break;
-                        }
-                    }
-                    if (!passed) {
-                        passed = true;
-                        break;
+                    failed = first_failed_check(p, page, offset);
+                    if (failed != p.checks.size()) {
+                        ++rejections[failed];
+                        continue;
                     }
-                    func(e, get_pool<It>()->get_ref_directly_e(page, offset)...);
+                    func(e, get_pool<It, read_only>()->get_ref_directly_e(page, offset)...);
                 }
             }
+            record_checks(p, s, rejections);
         }
 
     };
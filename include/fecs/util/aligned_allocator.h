@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+
+namespace fecs {
+
+    // Chunks of data written by different threads should not share a line of this size
+    inline constexpr size_t cache_line_size = 64;
+
+    // Allocates with the given alignment and pads every allocation to whole alignment blocks,
+    // so vector loads over the last block never leave the allocation
+    template<typename T, size_t Alignment>
+    class aligned_allocator {
+    public:
+        static_assert(Alignment >= alignof(T), "Alignment can not be weaker than alignof(T)");
+        static_assert((Alignment & (Alignment - 1)) == 0, "Alignment has to be a power of two");
+
+        using value_type = T;
+        static constexpr size_t alignment = Alignment;
+
+        template<typename U>
+        struct rebind {
+            using other = aligned_allocator<U, std::max(Alignment, alignof(U))>;
+        };
+
+        aligned_allocator() noexcept = default;
+
+        template<typename U, size_t A>
+        aligned_allocator(const aligned_allocator<U, A>&) noexcept {}
+
+        [[nodiscard]] T* allocate(size_t count) {
+            return static_cast<T*>(::operator new(padded_bytes(count), std::align_val_t{ Alignment }));
+        }
+
+        void deallocate(T* pointer, size_t count) noexcept {
+            ::operator delete(pointer, padded_bytes(count), std::align_val_t{ Alignment });
+        }
+
+        template<typename U, size_t A>
+        bool operator==(const aligned_allocator<U, A>&) const noexcept {
+            return true;
+        }
+
+    private:
+        static size_t padded_bytes(size_t count) {
+            return (count * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+        }
+
+    };
+
+}
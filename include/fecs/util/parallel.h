@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace fecs {
+
+    // Splits [0, count) into contiguous chunks of at least min_chunk elements and runs
+    // func(first, last) for each of them, one chunk per hardware thread.
+    // The calling thread takes the first chunk, small ranges never leave it.
+    // Chunks start at multiples of granularity, e.g. the elements of a cache line,
+    // so threads writing neighbouring chunks of aligned data do not share a line.
+    template<typename Func>
+    void parallel_for(size_t count, size_t min_chunk, Func func, size_t granularity = 1) {
+        const size_t hardware = std::max<size_t>(1, std::thread::hardware_concurrency());
+        const size_t chunks = std::clamp<size_t>(count / std::max<size_t>(1, min_chunk), 1, hardware);
+        if (chunks == 1) {
+            func(size_t{0}, count);
+            return;
+        }
+
+        granularity = std::max<size_t>(1, granularity);
+        const size_t chunk_size = ((count + chunks - 1) / chunks + granularity - 1) / granularity * granularity;
+        std::vector<std::thread> workers;
+        workers.reserve(chunks - 1);
+        for (size_t c = 1; c < chunks; ++c) {
+            const size_t first = c * chunk_size;
+            const size_t last = std::min(count, first + chunk_size);
+            if (first >= last) {
+                break;
+            }
+            workers.emplace_back(func, first, last);
+        }
+        func(size_t{0}, std::min(count, chunk_size));
+        for (std::thread& w : workers) {
+            w.join();
+        }
+    }
+
+}
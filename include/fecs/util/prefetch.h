@@ -0,0 +1,24 @@
+#pragma once
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    #include <xmmintrin.h>
+#endif
+
+// How many entities ahead queues prefetch their lookups, 0 disables prefetching
+#ifndef FECS_PREFETCH_DISTANCE
+    #define FECS_PREFETCH_DISTANCE 16
+#endif
+
+namespace fecs {
+
+    inline void prefetch(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(address, 0, 3);
+#elif defined(_MSC_VER)
+        _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+        (void)address;
+#endif
+    }
+
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <ostream>
+
+// Instrumentation is compiled in only with FECS_PROFILING, like FECS_LOGGING.
+// Every thread records finished scopes into its own ring buffer,
+// dump_chrome_trace writes them as Chrome trace-event JSON (chrome://tracing, Perfetto).
+
+#ifdef FECS_PROFILING
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifndef FECS_PROFILING_BUFFER_SIZE
+    #define FECS_PROFILING_BUFFER_SIZE 65536
+#endif
+
+namespace fecs::profiling {
+
+    struct trace_event {
+        const char* name = nullptr;
+        uint64_t begin_ns = 0;
+        uint64_t duration_ns = 0;
+    };
+
+    // Written only by its thread. When full, the oldest events are overwritten.
+    class trace_buffer {
+    public:
+        static constexpr size_t capacity = FECS_PROFILING_BUFFER_SIZE;
+
+        explicit trace_buffer(uint32_t thread_id)
+            : _thread_id(thread_id) {}
+
+        void push(const trace_event& event) {
+            const uint64_t head = _head.load(std::memory_order_relaxed);
+            _events[head % capacity] = event;
+            _head.store(head + 1, std::memory_order_release);
+        }
+
+        template<typename Func>
+        void for_each(Func func) const {
+            const uint64_t head = _head.load(std::memory_order_acquire);
+            const uint64_t first = head > capacity ? head - capacity : 0;
+            for (uint64_t i = first; i < head; ++i) {
+                func(_events[i % capacity]);
+            }
+        }
+
+        void clear() {
+            _head.store(0, std::memory_order_release);
+        }
+
+        [[nodiscard]] uint32_t thread_id() const {
+            return _thread_id;
+        }
+
+    private:
+        std::array<trace_event, capacity> _events{};
+        std::atomic<uint64_t> _head = 0;
+        uint32_t _thread_id;
+
+    };
+
+    class tracer {
+    public:
+        static tracer& instance() {
+            static tracer t;
+            return t;
+        }
+
+        // Buffers live as long as the tracer, so events of finished threads are kept
+        trace_buffer& local_buffer() {
+            thread_local trace_buffer* buffer = nullptr;
+            if (buffer == nullptr) [[unlikely]] {
+                std::lock_guard lock(_mutex);
+                _buffers.push_back(std::make_unique<trace_buffer>(static_cast<uint32_t>(_buffers.size())));
+                buffer = _buffers.back().get();
+            }
+            return *buffer;
+        }
+
+        [[nodiscard]] uint64_t now() const {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - _epoch).count());
+        }
+
+        // Events recorded while dumping may be torn, dump between frames
+        void dump_chrome_trace(std::ostream& os) {
+            std::lock_guard lock(_mutex);
+            os << "{\"traceEvents\":[";
+            bool first = true;
+            for (const auto& buffer : _buffers) {
+                buffer->for_each([&](const trace_event& e) {
+                    os << (first ? "" : ",")
+                       << "{\"name\":\"" << e.name
+                       << "\",\"cat\":\"fecs\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->thread_id()
+                       << ",\"ts\":" << static_cast<double>(e.begin_ns) / 1000.0
+                       << ",\"dur\":" << static_cast<double>(e.duration_ns) / 1000.0
+                       << '}';
+                    first = false;
+                });
+            }
+            os << "],\"displayTimeUnit\":\"ns\"}";
+        }
+
+        void clear() {
+            std::lock_guard lock(_mutex);
+            for (const auto& buffer : _buffers) {
+                buffer->clear();
+            }
+        }
+
+    private:
+        std::mutex _mutex;
+        std::vector<std::unique_ptr<trace_buffer>> _buffers;
+        std::chrono::steady_clock::time_point _epoch = std::chrono::steady_clock::now();
+
+        tracer() = default;
+
+    };
+
+    class trace_scope {
+    public:
+        explicit trace_scope(const char* name)
+            : _name(name), _begin(tracer::instance().now()) {}
+
+        ~trace_scope() {
+            tracer& t = tracer::instance();
+            t.local_buffer().push({ _name, _begin, t.now() - _begin });
+        }
+
+        trace_scope(const trace_scope&) = delete;
+        trace_scope& operator=(const trace_scope&) = delete;
+
+    private:
+        const char* _name;
+        uint64_t _begin;
+
+    };
+
+    inline void dump_chrome_trace(std::ostream& os) {
+        tracer::instance().dump_chrome_trace(os);
+    }
+
+    inline void clear() {
+        tracer::instance().clear();
+    }
+
+}
+
+#define FECS_PROFILE_CONCAT_IMPL(a, b) a##b
+#define FECS_PROFILE_CONCAT(a, b) FECS_PROFILE_CONCAT_IMPL(a, b)
+// name must be a string literal
+#define FECS_PROFILE_SCOPE(name) ::fecs::profiling::trace_scope FECS_PROFILE_CONCAT(fecs_trace_scope_, __LINE__)(name)
+
+#else
+
+namespace fecs::profiling {
+
+    // Keeps user code compiling when profiling is disabled
+    inline void dump_chrome_trace(std::ostream& os) {
+        os << "{\"traceEvents\":[]}";
+    }
+
+    inline void clear() {}
+
+}
+
+// Expand to nothing if profiling is disabled
+#define FECS_PROFILE_SCOPE(name) ((void)0)
+
+#endif
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../core/type_index.h"
+
+namespace fecs {
+
+    struct pool_stats {
+        id_index_t component = error_id_index;
+        size_t size = 0;
+        size_t capacity = 0;
+        size_t sparse_pages = 0;
+        size_t bytes = 0;
+        // Recent membership checks of views against the pool and how many failed
+        uint64_t view_checks = 0;
+        uint64_t view_rejections = 0;
+        // error_id_index if no group owns the pool
+        id_index_t owner_group = error_id_index;
+    };
+
+    struct group_stats {
+        id_index_t group = error_id_index;
+        size_t next_index = 0;
+        size_t emplace_swaps = 0;
+        size_t remove_swaps = 0;
+        size_t iterations = 0;
+        size_t iterated_entities = 0;
+    };
+
+    struct query_stats {
+        id_index_t query = error_id_index;
+        size_t driving_pool_size = 0;
+        size_t replans = 0;
+        size_t iterations = 0;
+    };
+
+    struct registry_stats {
+        std::vector<pool_stats> pools;
+        std::vector<group_stats> groups;
+        std::vector<query_stats> queries;
+    };
+
+    namespace details {
+
+        inline void write_json_id(std::ostream& os, id_index_t id) {
+            if (id == error_id_index) {
+                os << "null";
+            }
+            else {
+                os << id;
+            }
+        }
+
+    }
+
+    inline void write_json(std::ostream& os, const registry_stats& stats) {
+        os << "{\"pools\":[";
+        for (size_t i = 0; i < stats.pools.size(); ++i) {
+            const pool_stats& p = stats.pools[i];
+            os << (i ? "," : "")
+               << "{\"component\":" << p.component
+               << ",\"size\":" << p.size
+               << ",\"capacity\":" << p.capacity
+               << ",\"sparse_pages\":" << p.sparse_pages
+               << ",\"bytes\":" << p.bytes
+               << ",\"view_checks\":" << p.view_checks
+               << ",\"view_rejections\":" << p.view_rejections
+               << ",\"owner_group\":";
+            details::write_json_id(os, p.owner_group);
+            os << '}';
+        }
+        os << "],\"groups\":[";
+        for (size_t i = 0; i < stats.groups.size(); ++i) {
+            const group_stats& g = stats.groups[i];
+            os << (i ? "," : "")
+               << "{\"group\":" << g.group
+               << ",\"next_index\":" << g.next_index
+               << ",\"emplace_swaps\":" << g.emplace_swaps
+               << ",\"remove_swaps\":" << g.remove_swaps
+               << ",\"iterations\":" << g.iterations
+               << ",\"iterated_entities\":" << g.iterated_entities
+               << '}';
+        }
+        os << "],\"queries\":[";
+        for (size_t i = 0; i < stats.queries.size(); ++i) {
+            const query_stats& q = stats.queries[i];
+            os << (i ? "," : "")
+               << "{\"query\":" << q.query
+               << ",\"driving_pool_size\":" << q.driving_pool_size
+               << ",\"replans\":" << q.replans
+               << ",\"iterations\":" << q.iterations
+               << '}';
+        }
+        os << "]}";
+    }
+
+    [[nodiscard]] inline std::string to_json(const registry_stats& stats) {
+        std::ostringstream os;
+        write_json(os, stats);
+        return os.str();
+    }
+
+}